@@ -3,15 +3,7 @@
 #define SQRT2 0.70710678118654757
 
 uniform vec2 window;
-uniform vec3 sky_col;
-uniform vec3 sun_pos;
-uniform vec3 sun_col;
-uniform vec3 cloud_col;
-uniform float cloud_strength;
-uniform float sun_radius;
-uniform float sun_strength;
-uniform float waterline;
-uniform float exposure;
+// Parameters come from the param block, see mt::param_glsl.
 uniform sampler2D tex;
 
 layout(location = 0) in vec2 in_uv;
@@ -82,7 +74,7 @@ float pgnoise(vec2 uv, float alpha, uint n) {
   float amp = 1.f;
   float norm = 1.f;
   float f = amp*gnoise(uv);
-  while (--n) {
+  while (--n != 0u) {
     amp *= alpha;
     norm += amp;
     uv = m*uv;
@@ -138,7 +130,7 @@ void main() {
 
   // Coordinate manipulations.
   vec2 inuvc = in_uv * 2.f - 1.f;
-  float offset = waterline;
+  float offset = param.back_waterline;
   float under = aastep(offset, uv.y);
   inuvc.y = abs(inuvc.y - offset) + offset;
   inuvc = inuvc*0.5f + 0.5f;
@@ -151,8 +143,8 @@ void main() {
   vec4 raw = texture(tex, inuvc);
   inuvc.x *= window.x/window.y;
 
-  vec3 col = sky_col;
-  float dist = length(sun_pos.xy - inuvc);
+  vec3 col = param.back_bg_col;
+  float dist = length(param.back_sun_pos.xy - inuvc);
   dist = pow(dist, 3.f);
   col += pow(stars(inuvc*100.f + ns*200.f)*dist*20.f, 1.f);
 
@@ -211,26 +203,26 @@ void main() {
   }
   c += c1;
   f = cloudcover + cloudalpha*f*r;
-  vec3 cloudcolour = cloud_col * clamp((clouddark + cloudlight*c), 0.0, 1.0);
+  vec3 cloudcolour = param.back_cloud_col * clamp((clouddark + cloudlight*c), 0.0, 1.0);
   vec3 cloudres = mix(col, clamp(skytint * col + cloudcolour, 0.f, 1.f), clamp(f+c, 0.f, 1.f));
-  col = mix(col, cloudres, cloud_strength);
+  col = mix(col, cloudres, param.back_cloud_strength);
 
   // Sun.
-  vec2 diff = sun_pos.xy - inuvc;
+  vec2 diff = param.back_sun_pos.xy - inuvc;
   float ang = atan(diff.y, diff.x);
   float len = length(diff);
   float angn = pgnoise(vec2(0.f, 2.f*ang), 0.8f, 4);
-  col += (1.f + 0.7f*len*angn) * sun_strength * sun_col / max(len, sun_radius);
+  col += (1.f + 0.7f*len*angn) * param.back_sun_strength * param.back_sun_col / max(len, param.back_sun_radius);
 
   // Tree. Manually blended.
   col += raw.rgb + (1.f - raw.a)*col;
 
   // Post.
-  float v = vignette(sun_pos.xy, inuvc, -0.5f);
+  float v = vignette(param.back_sun_pos.xy, inuvc, -0.5f);
   col *= pow(v, 4.f);
   col *= (1.f - 0.02f*under);
   col *= grain(uv, 0.06f);
 
-  col = tone_map(col*exposure);
+  col = tone_map(col*param.back_exposure);
   out_col = vec4(col, 1.0);
 }
@@ -5,7 +5,6 @@
 
 uniform sampler2D tex;
 uniform vec2 window;
-uniform vec3 paper_col;
 
 layout(location = 0) in vec2 uv;
 layout(location = 0) out vec4 frag;
@@ -63,7 +62,7 @@ void main() {
   vec2 uvinv = vec2(1.f-uv.x, uv.y); // Mirror image.
   vec4 raw = texture(tex, uvinv);
 
-  vec3 col = paper_col;
+  vec3 col = param.front_paper_col;
 
   col *= 1.f - length(uvn) * 0.1f;
   col *= grain(uvn, 0.01f);
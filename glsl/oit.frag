@@ -0,0 +1,34 @@
+#version 430
+
+#define SQRT2 0.70710678118654757
+
+layout(location = 0) in vec2 uv;
+layout(location = 1) in vec4 color;
+layout(location = 2) in float additive;
+
+layout(location = 0) out vec4 accum;
+layout(location = 1) out float reveal;
+layout(location = 2) out vec4 added;
+
+// Anti-aliased smoothstep.
+float aastep(float lim, float val) {
+  float diff = length(vec2(dFdx(val), dFdy(val))) * SQRT2;
+  return smoothstep(lim - diff, lim + diff, val);
+}
+
+// Weighted blended order-independent transparency (McGuire & Bavoil 2013).
+// The additive part of the colour has no alpha to weigh it by, so it is
+// summed separately.
+void main() {
+  float mag = 1.f - aastep(0.8f, length(uv));
+  vec4 col = color*mag; // Premultiplied alpha.
+
+  // Nearer and more opaque fragments weigh more.
+  float a = clamp(col.a, 0.f, 1.f);
+  float z = 1.f - gl_FragCoord.z*0.9f;
+  float w = clamp(pow(min(1.f, a*10.f) + 0.01f, 3.f) * 1e8 * z*z*z, 1e-2, 3e3);
+
+  accum = vec4(col.rgb*(1.f - additive), a)*w;
+  reveal = a;
+  added = vec4(col.rgb*additive, 0.f);
+}
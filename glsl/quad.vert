@@ -6,14 +6,27 @@ uniform mat4 proj;
 uniform uint rotation;
 
 layout(location = 0) in vec2 box;
-layout(location = 1) in vec4 pos;
-layout(location = 2) in vec4 cola;
-layout(location = 3) in vec4 colb;
-layout(location = 4) in vec4 attr;
-layout(location = 5) in vec4 dir;
+
+// Packed atoms, see mt::gpu_atom.
+struct atom {
+  uint pos_xy;
+  uint pos_zs;
+  uint col;
+  uint attr;
+};
+
+layout(std430, binding = 0) readonly buffer atoms {
+  atom data[];
+};
+
+// Half float quaternions, only filled when rotating.
+layout(std430, binding = 1) readonly buffer dirs {
+  uvec2 quats[];
+};
 
 layout(location = 0) out vec2 uv;
 layout(location = 1) out vec4 color;
+layout(location = 2) out float additive; // Part of color added without alpha.
 
 // These constants are necessary for continuity of luminance.
 const float eps = 216.0/24389.0;
@@ -68,13 +81,23 @@ vec3 rotate(vec3 pos, vec4 quat) {
 }
 
 void main() {
+  atom a = data[gl_InstanceID];
+  vec4 pos = vec4(unpackHalf2x16(a.pos_xy), unpackHalf2x16(a.pos_zs));
+  vec4 col = unpackUnorm4x8(a.col) * vec4(200.f, 300.f, 255.f/256.f*360.f, 255.f/25.f);
+  float add = float(a.attr & 0xffu) / 255.f;
+  vec4 dir = vec4(0.f, 0.f, 0.f, 1.f);
+  if (rotation != 0u) {
+    uvec2 q = quats[gl_InstanceID];
+    dir = vec4(unpackHalf2x16(q.x), unpackHalf2x16(q.y));
+  }
+
   float size = pos.w;
   vec3 uvc = vec3(box*2.f - 1.f, 0.f);
   vec3 quad = uvc * size;
   vec3 rotated = rotate(quad, dir);
 
   vec4 p;
-  if (rotation) {
+  if (rotation != 0u) {
     p = mv * vec4(pos.xyz + rotated, 1.f);
   } else {
     vec4 eye_pos = mv * vec4(pos.xyz, 1.f);
@@ -82,10 +105,11 @@ void main() {
   }
   gl_Position = proj * p;
 
-  vec3 rgb = lab2rgb(cart(cola.xyz));
-  float ad = clamp(1.f - colb.w, 0.f, 1.f);
-  float op = clamp(cola.w, 0.f, 100.f);
+  vec3 rgb = lab2rgb(cart(col.xyz));
+  float ad = clamp(1.f - add, 0.f, 1.f);
+  float op = col.w;
 
   color = vec4(rgb, ad) * op; // Premultiplied alpha.
+  additive = 1.f - ad;
   uv = uvc.xy;
 }
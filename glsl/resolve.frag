@@ -0,0 +1,19 @@
+#version 430
+
+layout(location = 0) in vec2 uv;
+layout(location = 0) out vec4 frag;
+
+uniform sampler2D accum;
+uniform sampler2D reveal;
+uniform sampler2D added;
+
+// Composite weighted blended transparency, as premultiplied alpha, plus the
+// additive light.
+void main() {
+  vec4 acc = texture(accum, uv);
+  float alpha = 1.f - texture(reveal, uv).r;
+  vec3 add = texture(added, uv).rgb;
+  if (alpha <= 0.f && add == vec3(0.f)) discard;
+  vec3 col = acc.rgb / clamp(acc.a, 1e-4, 5e4);
+  frag = vec4(col*alpha + add, alpha);
+}
@@ -1,130 +1,284 @@
 #include "algo.h"
 
 #include <limits>
+#include <algorithm>
+#include <cmath>
+#include <thread>
 
-#include <glm/gtc/random.hpp>
-#include <glm/gtx/rotate_vector.hpp>
-#include <glm/gtx/vector_angle.hpp>
 #include <glm/gtx/spline.hpp>
+#include <glm/gtc/constants.hpp>
 
-#include "config.h"
+#include "simd.h"
+#include "rng.h"
 
 namespace mt {
 
   // Area of outside of cylinder.
   static float cyl_area(float r, float h) {
-    return mt::tau*r*h;
+    return glm::two_pi<double>()*r*h;
   }
 
   // Volume of cylinder.
   static float cyl_volume(float r, float h) {
-    return mt::pi*r*r*h;
+    return glm::pi<double>()*r*r*h;
   }
 
-  // Return random vector on cylinder surface.
-  static glm::vec3 cyl_rand(glm::vec3 dir, float r) {
-    glm::vec2 circ = glm::circularRand(r);
-    float y = glm::linearRand(0.f, glm::length(dir));
+  // Rotation taking the up axis to a direction.
+  struct basis {
+    glm::vec3 x, y, z; // Images of the unit axes.
+  };
 
-    glm::vec3 res = glm::vec3(circ.x, y, circ.y);
-
-    glm::vec3 up = glm::vec3(0.f, 1.f, 0.f);
-    // Rotate to direction.
+  // Return rotation of up axis onto dir, by Rodrigues' formula without trig.
+  static mt::basis rotation(glm::vec3 dir) {
+    if (dir == glm::vec3(0.f))
+      return { glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.f, 0.f, 1.f) };
     dir = glm::normalize(dir);
-    if (dir == up || dir == glm::vec3(0.f))
-      return res;
-    else  {
-      glm::vec3 axis = glm::cross(dir, up);
-      float angle = glm::angle(dir, up);
-      return glm::rotate(res, -angle, axis);
+    float c = dir.y;
+    if (c <= -1.f)
+      return { glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f, -1.f, 0.f), glm::vec3(0.f, 0.f, -1.f) };
+
+    // Axis is cross(up, dir), scaled by the sine of the angle.
+    float vx = dir.z, vz = -dir.x;
+    float k = 1.f/(1.f + c);
+    return {
+      glm::vec3(c + k*vx*vx, vz, k*vx*vz),
+      glm::vec3(-vz, c, vx),
+      glm::vec3(k*vx*vz, -vx, c + k*vz*vz)
+    };
+  }
+
+  // Turn local samples (rad*sa*cos, rad*ca + off, rad*sa*sin) into points
+  // rotated by b. Angles must be in res.ang.
+  static void place(const mt::basis& b, mt::samples& res) {
+    size_t n = res.x.size();
+    mt::sincos(res.ang.data(), n, res.sin.data(), res.cos.data());
+    for (size_t i = 0; i < n; ++i) {
+      float lx = res.rad[i]*res.sa[i]*res.cos[i];
+      float ly = res.rad[i]*res.ca[i] + res.off[i];
+      float lz = res.rad[i]*res.sa[i]*res.sin[i];
+      res.x[i] = lx*b.x.x + ly*b.y.x + lz*b.z.x;
+      res.y[i] = lx*b.x.y + ly*b.y.y + lz*b.z.y;
+      res.z[i] = lx*b.x.z + ly*b.y.z + lz*b.z.z;
     }
   }
 
   // Area of bulge. Used for normalizing density.
   static float bulge_area(float x, float y) {
     y = glm::clamp(y, 0.f, x);
-    if (y == 0.f) return mt::pi*x*x;
+    if (y == 0.f) return glm::pi<double>()*x*x;
     float r = y/2.f + x*x/(2.f*y);
-    return mt::tau*r*y;
+    return glm::two_pi<double>()*r*y;
   }
 
-  // Return random vector inside circle with curvature out of plane.
-  static glm::vec3 bulge_rand(glm::vec3 dir, float x, float y) {
-    glm::vec3 up = glm::vec3(0.f, 1.f, 0.f);
-    glm::vec3 res;
-    y = glm::clamp(y, 0.f, x);
+  // Fill res with random vectors inside circles of radius x[i] with
+  // curvature y[i] out of plane. Sample i is drawn from stream at index
+  // first + i.
+  static void bulge_rand(glm::vec3 dir, const std::vector<float>& x, const std::vector<float>& y,
+      uint32_t seed, mt::rng_stream stream, size_t first, mt::samples& res) {
+    size_t n = x.size();
+    res.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      mt::rng rnd(seed, stream, first + i);
+      float h = glm::clamp(y[i], 0.f, x[i]);
+
+      if (h == 0.f) {
+        res.rad[i] = x[i]*std::sqrt(rnd.uniform());
+        res.ang[i] = rnd.uniform(0.f, glm::two_pi<float>());
+        res.sa[i] = 1.f;
+        res.ca[i] = 0.f;
+        res.off[i] = 0.f;
+      } else {
+        // Calculate y-point of origin of sphere.
+        float yc = h/2.f - x[i]*x[i]/(2.f*h);
+        float r = h - yc;
+        float a = h/r/2.f;
+
+        res.ang[i] = rnd.uniform(0.f, glm::two_pi<float>());
+        float ca = 1.f - 2.f*rnd.uniform(0.f, a);
+        res.rad[i] = r;
+        res.ca[i] = ca;
+        res.sa[i] = std::sqrt(std::max(0.f, 1.f - ca*ca));
+        res.off[i] = yc;
+      }
+    }
+    place(rotation(dir), res);
+  }
+
+  void samples::resize(size_t n) {
+    for (auto v : { &x, &y, &z, &rad, &off, &ca, &sa, &ang, &sin, &cos })
+      v->resize(n);
+  }
+
+  // Empty grid and set new cell size.
+  void grid::reset(float cell) {
+    cells.clear();
+    cell_size = cell;
+  }
+
+  // Pack cell coordinates into a single key.
+  uint64_t grid::key(int x, int y, int z) const {
+    const uint64_t mask = (1 << 21) - 1;
+    return ((uint64_t)x & mask) | (((uint64_t)y & mask) << 21) | (((uint64_t)z & mask) << 42);
+  }
+
+  // Cell coordinates of a point.
+  glm::ivec3 grid::cell(const glm::vec3& p) const {
+    return glm::ivec3(std::floor(p.x/cell_size), std::floor(p.y/cell_size), std::floor(p.z/cell_size));
+  }
 
-    if (y == 0.f) {
-      auto r = glm::diskRand(x);
-      res = glm::vec3(r.x, 0.f, r.y);
+  // Add index at position.
+  void grid::insert(uint32_t idx, const glm::vec3& p) {
+    if (cells.empty()) {
+      lo = p;
+      hi = p;
     } else {
-      // Calculate y-point of origin of sphere.
-      float yc = y/2.f - x*x/(2.f*y);
-      float r = y - yc;
-      float a = y/r/2.f;
-
-      float polar = glm::linearRand(0.f, (float)mt::tau);
-      float azi = glm::acos(1.f - 2.f*glm::linearRand(0.f, a));
-      res = r * glm::vec3(sin(azi)*cos(polar), cos(azi), sin(azi)*sin(polar));
-      res.y += yc;
+      lo = glm::min(lo, p);
+      hi = glm::max(hi, p);
     }
+    auto c = cell(p);
+    auto& b = cells[key(c.x, c.y, c.z)];
+    b.idx.push_back(idx);
+    b.x.push_back(p.x);
+    b.y.push_back(p.y);
+    b.z.push_back(p.z);
+  }
 
-    // Rotate to direction.
-    dir = glm::normalize(dir);
-    if (dir == up || dir == glm::vec3(0.f))
-      return res;
-    else  {
-      glm::vec3 axis = glm::cross(dir, up);
-      float angle = glm::angle(dir, up);
-      return glm::rotate(res, -angle, axis);
-    }
+  // Remove index which was inserted at position.
+  void grid::remove(uint32_t idx, const glm::vec3& p) {
+    auto c = cell(p);
+    auto it = cells.find(key(c.x, c.y, c.z));
+    if (it == cells.end()) return;
+    auto& b = it->second;
+    auto found = std::find(b.idx.begin(), b.idx.end(), idx);
+    if (found == b.idx.end()) return;
+
+    size_t i = found - b.idx.begin();
+    b.idx[i] = b.idx.back();
+    b.x[i] = b.x.back();
+    b.y[i] = b.y.back();
+    b.z[i] = b.z.back();
+    b.idx.pop_back();
+    b.x.pop_back();
+    b.y.pop_back();
+    b.z.pop_back();
+    if (b.idx.empty()) cells.erase(it);
+  }
+
+  // Gather indices and squared distances of all points closer than rad to p.
+  size_t grid::query(const glm::vec3& p, float rad, std::vector<uint32_t>& idx, std::vector<float>& d2) const {
+    idx.clear();
+    d2.clear();
+    if (cells.empty()) return 0;
+    auto a = glm::max(p - glm::vec3(rad), lo);
+    auto b = glm::min(p + glm::vec3(rad), hi);
+    if (a.x > b.x || a.y > b.y || a.z > b.z) return 0;
+
+    auto c0 = cell(a);
+    auto c1 = cell(b);
+    for (int z = c0.z; z <= c1.z; ++z)
+      for (int y = c0.y; y <= c1.y; ++y)
+        for (int x = c0.x; x <= c1.x; ++x) {
+          auto it = cells.find(key(x, y, z));
+          if (it == cells.end()) continue;
+
+          auto& bn = it->second;
+          size_t len = idx.size();
+          idx.resize(len + bn.idx.size());
+          d2.resize(len + bn.idx.size());
+          size_t num = mt::within(bn.x.data(), bn.y.data(), bn.z.data(), bn.idx.size(),
+              p, rad*rad, &idx[len], &d2[len]);
+          for (size_t k = len; k < len + num; ++k)
+            idx[k] = bn.idx[idx[k]];
+          idx.resize(len + num);
+          d2.resize(len + num);
+        }
+    return idx.size();
+  }
+
+  // Trunk width of node, grows with the number of tips it carries.
+  float node_array::width(size_t i) const {
+    if (i == 0) return 0.f; // Genesis node is never shown.
+    return std::pow(tips[i]*tip_width, growth);
   }
 
-  // Node class constructor.
-  node::node(glm::vec3 p): 
-    pos(p),
-    size(0.f),
-    parent_idx(-1),
-    done(false) {
+  // Append node.
+  void node_array::push_back(const glm::vec3& p, int32_t par) {
+    x.push_back(p.x);
+    y.push_back(p.y);
+    z.push_back(p.z);
+    parent.push_back(par);
+    tips.push_back(1);
+    tip.push_back(true);
+    attr_sum.push_back(glm::vec3(0.f));
+    attr_num.push_back(0);
+
+    // Extending a tip keeps the tip count; a new branch adds one to all
+    // ancestors.
+    if (par < 0) return;
+    if (tip[par]) {
+      tip[par] = false;
+      return;
+    }
+    for (int32_t i = par; i >= 0; i = parent[i])
+      tips[i]++;
   }
 
   // Spawn new node in average direction of attractors.
-  node node::grow(float mag) {
-    glm::vec3 avg = glm::vec3(0.f);
-    for (size_t i = 0; i < attr.size(); ++i)
-      avg += attr[i];
-    avg /= (float)attr.size();
+  void node_array::grow(size_t i, float mag) {
+    glm::vec3 avg = attr_sum[i] / (float)attr_num[i];
 
-    attr.clear();
-    glm::vec3 dir = glm::normalize(avg - pos) * mag;
-    auto n = node(pos + dir);
-    return n;
+    attr_sum[i] = glm::vec3(0.f);
+    attr_num[i] = 0;
+    glm::vec3 dir = glm::normalize(avg - pos(i)) * mag;
+    push_back(pos(i) + dir, i);
   }
 
-  // Attractor class constructor.
-  attractor::attractor(glm::vec3 p):
-    pos(p),
-    dist(std::numeric_limits<float>::max()),
-    alive(true),
-    node_idx(-1) {
+  void node_array::clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    parent.clear();
+    tips.clear();
+    tip.clear();
+    attr_sum.clear();
+    attr_num.clear();
   }
 
-  // Find closest node and add own position as influence.
-  void attractor::attract(std::vector<mt::node>& nds, size_t start, float min) {
-    for (size_t i = start; i < nds.size(); ++i) {
-      float mag = glm::distance(nds[i].pos, pos);
-      if (mag <= dist) {
-        dist = mag;
-        node_idx = i;
-      }
+  // Append live attractor.
+  void attr_array::push_back(const glm::vec3& p) {
+    if (size() % 64 == 0) live.push_back(0);
+    live.back() |= uint64_t(1) << (size() % 64);
+    x.push_back(p.x);
+    y.push_back(p.y);
+    z.push_back(p.z);
+    dist2.push_back(std::numeric_limits<float>::max());
+    node.push_back(-1);
+    listed.push_back(false);
+  }
+
+  // Keep node if it is the closest so far. Ties are resolved in favour of
+  // the newest node regardless of the order in which nodes are offered.
+  void attr_array::attract(size_t i, int32_t idx, float d2) {
+    if (d2 < dist2[i] || (d2 == dist2[i] && idx > node[i])) {
+      dist2[i] = d2;
+      node[i] = idx;
     }
-    if (dist < min && node_idx >= 0)
-      nds[node_idx].attr.push_back(pos);
+  }
+
+  void attr_array::clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    dist2.clear();
+    node.clear();
+    live.clear();
+    listed.clear();
   }
 
   // Initialize colony; node and attractors.
   void colony::init() {
     last = 0;
+    steps = 0;
     iter = 0.f;
     finished = false;
     cursor = base;
@@ -132,6 +286,8 @@ namespace mt {
 
     attr.clear();
     nodes.clear();
+    nodes.tip_width = min_branch_size;
+    nodes.growth = branch_growth_factor;
     leaves.clear();
     bark.clear();
     attr.push_back(cursor);
@@ -139,171 +295,244 @@ namespace mt {
 
     create_envelope();
     attr_alive = attr.size();
+    attr_dead = 0;
+
+    near.clear();
+    field.reset(attr_rad);
+    for (size_t i = 0; i < attr.size(); ++i)
+      field.insert(i, attr.pos(i));
   }
 
-  static glm::vec3 next_env(glm::vec3 dir, float d, float y, float ppv, float* du) {
-    auto vec = bulge_rand(dir, d*0.5f, y);
-    vec -= dir*y;
-    float area = bulge_area(d*0.5f, y);
-    *du = 1.f / (area*ppv);
-    return vec;
+  // Sample envelope in slices of width d[i] and bulge y[i] at cursor c[i],
+  // moving along dir, and add the points as attractors.
+  static void fill_env(glm::vec3 dir, const std::vector<float>& d, const std::vector<float>& y,
+      const std::vector<glm::vec3>& c, uint32_t seed, mt::rng_stream stream, size_t first,
+      mt::samples& res, mt::attr_array& attr) {
+    std::vector<float> x(d.size());
+    for (size_t i = 0; i < d.size(); ++i)
+      x[i] = d[i]*0.5f;
+    bulge_rand(dir, x, y, seed, stream, first, res);
+
+    for (size_t i = 0; i < d.size(); ++i) {
+      glm::vec3 vec = glm::vec3(res.x[i], res.y[i], res.z[i]) - dir*y[i];
+      attr.push_back(c[i] + vec);
+    }
   }
 
   // Create attraction points for tree envelope.
   void colony::create_envelope() {
-    float du;
+    // Spacing only depends on position, so lay out the slices first.
+    std::vector<float> d, y;
+    std::vector<glm::vec3> c;
     while (iter < env_length) {
       float i = iter/env_length;
       float w = glm::mix(trunk_width, env_width, i*i);
-      float y = glm::mix(0.f, env_width*0.5f, i);
+      float h = glm::mix(0.f, env_width*0.5f, i);
       float ppv = glm::mix(trunk_ppv, env_ppv, i*i*i*i*i);
 
-      auto res = next_env(grow_dir, w, y, ppv, &du);
-      attr.push_back(cursor + res);
+      d.push_back(w);
+      y.push_back(h);
+      c.push_back(cursor);
 
+      float du = 1.f / (bulge_area(w*0.5f, h)*ppv);
       iter += du;
       cursor += grow_dir*du;
     }
-
+    fill_env(grow_dir, d, y, c, seed, mt::ENVELOPE, attr.size(), batch, attr);
   }
 
   // Create attraction points for roots.
   void colony::create_roots() {
     cursor = base;
     iter = 0.f;
+    size_t first = attr.size();
 
-    float du;
+    std::vector<float> d, y;
+    std::vector<glm::vec3> c;
     while (iter < root_length) {
       float i = iter/root_length;
       float w = glm::mix(trunk_width, root_width, i);
-      float y = glm::mix(0.f, root_width*0.5f, i);
+      float h = glm::mix(0.f, root_width*0.5f, i);
       float ppv = glm::mix(root_ppv, root_ppv, i);
 
-      auto res = next_env(-grow_dir, w, y, ppv, &du);
-      attr.push_back(cursor + res);
+      d.push_back(w);
+      y.push_back(h);
+      c.push_back(cursor);
 
+      float du = 1.f / (bulge_area(w*0.5f, h)*ppv);
       iter += du;
       cursor += -grow_dir*du;
     }
+    fill_env(-grow_dir, d, y, c, seed, mt::ROOTS, 0, batch, attr);
+
+    for (size_t i = first; i < attr.size(); ++i)
+      field.insert(i, attr.pos(i));
 
     // First node of roots.
-    auto rp = base - grow_dir*unit;
-    auto nn = node(rp);
-    nn.parent_idx = 0;
-    nodes[0].child_idx.push_back(nodes.size());
-    nodes.push_back(nn);
+    nodes.push_back(base - grow_dir*unit, 0);
   }
 
-  static glm::vec3 donut_rand(glm::vec3 dir, float rad, float sd) {
-    auto xy = glm::circularRand(glm::linearRand(0.f, rad));
-    /* auto xy = glm::circularRand(glm::gaussRand(rad, sd)); */
-    auto res = glm::vec3(xy.x, 0.f, xy.y);
-    auto up = glm::vec3(0.f, 1.f, 0.f);
-
-    // Rotate to direction.
-    dir = glm::normalize(dir);
-    if (dir == up || dir == glm::vec3(0.f))
-      return res;
-    else  {
-      glm::vec3 axis = glm::cross(dir, up);
-      float angle = glm::angle(dir, up);
-      return glm::rotate(res, -angle, axis);
+  // Fill res with random vectors inside circles of radius rad[i] around
+  // dir[i]. Continues the random stream of each sample.
+  static void donut_rand(const std::vector<glm::vec3>& dir, const std::vector<float>& rad,
+      std::vector<mt::rng>& rnd, mt::samples& res) {
+    size_t n = dir.size();
+    res.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      res.rad[i] = rnd[i].uniform(0.f, rad[i]);
+      res.ang[i] = rnd[i].uniform(0.f, glm::two_pi<float>());
+    }
+    mt::sincos(res.ang.data(), n, res.sin.data(), res.cos.data());
+
+    for (size_t i = 0; i < n; ++i) {
+      mt::basis b = rotation(dir[i]);
+      float lx = res.rad[i]*res.cos[i];
+      float lz = res.rad[i]*res.sin[i];
+      res.x[i] = lx*b.x.x + lz*b.z.x;
+      res.y[i] = lx*b.x.y + lz*b.z.y;
+      res.z[i] = lx*b.x.z + lz*b.z.z;
     }
   }
 
-  static bool chance(float prob) {
-    float r = std::rand() / (float)RAND_MAX;
+  // Minimum number of new nodes per worker thread.
+  static const size_t min_work = 64;
+
+  static bool chance(float prob, mt::rng& rnd) {
+    float r = rnd.uniform();
     return (r <= glm::clamp(prob, 0.f, 1.f));
   }
 
+  // Find attractors in range of nodes [start, end). Only reads colony state.
+  void colony::attract(size_t start, size_t end, mt::worker& w) {
+    float rad = std::max(attr_rad, kill_rad);
+    w.hits.clear();
+    for (size_t i = start; i < end; ++i) {
+      size_t num = field.query(nodes.pos(i), rad, w.found, w.dist2);
+      for (size_t k = 0; k < num; ++k) {
+        uint32_t a = w.found[k];
+        if (w.dist2[k] <= attr.dist2[a])
+          w.hits.push_back({ a, (uint32_t)i, w.dist2[k] });
+      }
+    }
+  }
+
   // Perform one iteration of the space colonization algorithm.
   void colony::step() {
     if (attr.size() == 0) return;
-    for (size_t i = 0; i < attr.size(); ++i)
-      if (attr[i].alive)
-        attr[i].attract(nodes, last, attr_rad);
 
-    float step = unit-0.002f*std::pow(1.f - attr_alive/(float)attr.size(), 0.5f);
-    // If nodes are still growing.
-    if (nodes.size() != last) {
-      last = nodes.size();
-      for (size_t i = 0; i < nodes.size(); ++i) {
-        if (nodes[i].attr.size() > 0) {
-          auto n = nodes[i].grow(step);
-          n.parent_idx = i;
-          float d = glm::distance(n.pos, nodes[0].pos);
-          max_dist = std::max(d, max_dist);
-          nodes[i].child_idx.push_back(nodes.size());
-          nodes.push_back(n);
+    // Only nodes grown since the last step can become the closest node of an
+    // attractor, so only the attractors around those nodes are visited. The
+    // search is split over workers and merged in a fixed order.
+    size_t num = nodes.size() - last;
+    size_t count = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    count = std::max<size_t>(1, std::min(count, num/min_work));
+    workers.resize(std::max(workers.size(), count));
+
+    pool.run(count, [&](size_t t) {
+      attract(last + num*t/count, last + num*(t+1)/count, workers[t]);
+    });
+
+    // Ties are resolved by node index, so the merge order does not matter.
+    size_t listed = near.size();
+    for (size_t t = 0; t < count; ++t) {
+      auto& hits = workers[t].hits;
+      for (size_t k = 0; k < hits.size(); ++k) {
+        uint32_t a = hits[k].attr_idx;
+        attr.attract(a, hits[k].node_idx, hits[k].dist2);
+        if (!attr.listed[a]) {
+          attr.listed[a] = true;
+          near.push_back(a);
         }
       }
-
-      // Each iteration the trunk sizes are computed from scratch.
-      for (size_t i = 0; i < nodes.size(); ++i)
-        nodes[i].size = 0.f;
-
-      // Propagate backwards from child to parent to calculate trunk widths.
-      for (int i = nodes.size()-1; i > 0; --i) {
-        if (nodes[i].size == 0.f) nodes[i].size = min_branch_size;
-
-        int p = nodes[i].parent_idx;
-        nodes[p].size += nodes[i].size;
+    }
+    // Keep near sorted so influence is always summed in the same order.
+    std::sort(near.begin() + listed, near.end());
+    std::inplace_merge(near.begin(), near.begin() + listed, near.end());
+
+    // Add own position as influence to closest node.
+    growing.clear();
+    for (size_t k = 0; k < near.size(); ++k) {
+      uint32_t a = near[k];
+      if (attr.dist2[a] < attr_rad*attr_rad) {
+        int32_t n = attr.node[a];
+        if (nodes.attr_num[n]++ == 0) growing.push_back(n);
+        nodes.attr_sum[n] += attr.pos(a);
       }
-      nodes[0].size = 0.f; // Genesis node is never shown.
+    }
+    std::sort(growing.begin(), growing.end());
 
-      // Square root all node sizes.
-      for (size_t i = 0; i < nodes.size(); ++i)
-        nodes[i].size = std::pow(nodes[i].size, branch_growth_factor);
+    float step = unit-0.002f*std::pow(1.f - attr_alive/(float)attr.size(), 0.5f);
+    // If nodes are still growing.
+    if (nodes.size() != last && (max_steps == 0 || steps < max_steps)) {
+      last = nodes.size();
+      steps++;
+      for (size_t k = 0; k < growing.size(); ++k) {
+        nodes.grow(growing[k], step);
+        float d = glm::distance(nodes.pos(nodes.size()-1), nodes.pos(0));
+        max_dist = std::max(d, max_dist);
+      }
 
-      attr_alive = attr.size();
-      for (size_t i = 0; i < attr.size(); ++i)
-        if (attr[i].dist < kill_rad) {
-          attr[i].alive = false;
-          attr_alive--;
+      // Kill attractors which are reached by a node.
+      size_t n = 0;
+      for (size_t k = 0; k < near.size(); ++k) {
+        uint32_t a = near[k];
+        if (attr.dist2[a] < kill_rad*kill_rad) {
+          attr.kill(a);
+          field.remove(a, attr.pos(a));
+          attr_dead++;
+        } else {
+          near[n++] = near[k];
         }
+      }
+      near.resize(n);
+      attr_alive = attr.size() - attr_dead;
 
       // Sloppy...
       if (nodes.size() == 20) create_roots();
 
     } else if (!finished) {
+      // Pick leaf anchors, then place all leaves in one batch.
+      std::vector<glm::vec3> anchor, dirs;
+      std::vector<float> rad;
+      std::vector<mt::rng> rnds;
       for (int i = nodes.size()-1; i > 0; --i) {
         // Add leaves.
-        if (nodes[i].size < max_branch_leaves && nodes[i].pos.y >= unit*30.f) {
-          int p = nodes[i].parent_idx;
-          auto fin = nodes[p].pos;
-          auto start = nodes[i].pos;
+        float width = nodes.width(i);
+        if (width < max_branch_leaves && nodes.y[i] >= unit*30.f) {
+          mt::rng rnd(seed, mt::LEAVES, i);
+          int p = nodes.parent[i];
+          auto fin = nodes.pos(p);
+          auto start = nodes.pos(i);
           auto dir = fin - start;
 
           int segs = 1;
           for (int k = 0; k < segs; ++k) {
             auto an = start + dir*(k/(float)segs);
-            float d = glm::distance(an, nodes[0].pos)/max_dist;
+            float d = glm::distance(an, nodes.pos(0))/max_dist;
 
-            if (chance(0.1f*glm::smoothstep(0.01f, 0.1f, d))) {
-              auto pt = donut_rand(dir, std::sqrt(nodes[i].size)/5.f, unit);
-              leaves.push_back(pt + an);
+            if (chance(0.1f*glm::smoothstep(0.01f, 0.1f, d), rnd)) {
+              anchor.push_back(an);
+              dirs.push_back(dir);
+              rad.push_back(std::sqrt(width)/5.f);
+              rnds.push_back(rnd);
             }
           }
         }
-        finished = true;
       }
+
+      donut_rand(dirs, rad, rnds, batch);
+      for (size_t i = 0; i < anchor.size(); ++i)
+        leaves.push_back(anchor[i] + glm::vec3(batch.x[i], batch.y[i], batch.z[i]));
+      finished = true;
     }
 
   }
 
-  // Return nearest point. Pass pointer to also return distance.
-  static glm::vec3 nearest(const std::vector<glm::vec3>& arr, const glm::vec3& p, float* mag) {
-    if (arr.size() == 0) return p;
-    glm::vec3 res;
-    float dist = std::numeric_limits<float>::max();
-    for (size_t i = 0; i < arr.size(); ++i) {
-      float d = glm::distance(arr[i], p);
-      if (d < dist) {
-        res = arr[i];
-        dist = d;
-      }
-    }
-    *mag = dist;
+  // Return index of nearest node. Pass pointer to also return distance.
+  static size_t nearest(const mt::node_array& nds, const glm::vec3& p, float* mag) {
+    float d2;
+    size_t res = mt::closest(nds.x.data(), nds.y.data(), nds.z.data(), nds.size(), p, &d2);
+    *mag = std::sqrt(d2);
     return res;
   }
 
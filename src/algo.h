@@ -2,39 +2,122 @@
 
 #include <vector>
 #include <limits>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
 
 #include <glm/glm.hpp>
 
+#include "pool.h"
+
 namespace mt {
 
-  // Node of a single branch.
-  class node {
+  // Uniform spatial hash grid of point indices.
+  class grid {
   public:
-    node(glm::vec3 p = glm::vec3(0.f));
-
-    node grow(float mag);
+    grid(float cell = 1.f): cell_size(cell) {}
+
+    void reset(float cell);
+    void insert(uint32_t idx, const glm::vec3& p);
+    void remove(uint32_t idx, const glm::vec3& p);
+    size_t query(const glm::vec3& p, float rad, std::vector<uint32_t>& idx, std::vector<float>& d2) const;
+    bool empty() const { return cells.empty(); }
+
+  private:
+    // Points of a single cell.
+    struct bin {
+      std::vector<uint32_t> idx;
+      std::vector<float> x, y, z;
+    };
+
+    uint64_t key(int x, int y, int z) const;
+    glm::ivec3 cell(const glm::vec3& p) const;
+
+    std::unordered_map<uint64_t, bin> cells;
+    float cell_size;
+    glm::vec3 lo, hi; // Bounds of all inserted points.
+  };
 
-    std::vector<glm::vec3> attr;
+  // Node of a single branch.
+  struct node {
     glm::vec3 pos;
     float size;
     int parent_idx;
-    std::vector<int> child_idx;
-    bool done;
   };
 
-  // Points of attraction for the nodes.
-  class attractor {
-  public:
-    attractor(glm::vec3 p = glm::vec3(0.f));
-
-    void attract(std::vector<mt::node>& nds, size_t start, float min);
-
+  // Point of attraction for the nodes.
+  struct attractor {
     glm::vec3 pos;
     float dist;
     bool alive;
     int node_idx;
   };
 
+  // Structure-of-arrays storage of all nodes.
+  class node_array {
+  public:
+    size_t size() const { return x.size(); }
+    glm::vec3 pos(size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+    mt::node operator[](size_t i) const { return { pos(i), width(i), parent[i] }; }
+    float width(size_t i) const;
+
+    void push_back(const glm::vec3& p, int32_t par = -1);
+    void grow(size_t i, float mag);
+    void clear();
+
+    std::vector<float> x, y, z;
+    std::vector<int32_t> parent;
+    std::vector<uint32_t> tips; // Number of branch tips in subtree.
+    std::vector<bool> tip; // Node has no children yet.
+    float tip_width = 1e-5f;
+    float growth = 0.65f;
+    std::vector<glm::vec3> attr_sum; // Sum of influencing attractor positions.
+    std::vector<uint32_t> attr_num;
+  };
+
+  // Structure-of-arrays storage of all attractors.
+  class attr_array {
+  public:
+    size_t size() const { return x.size(); }
+    glm::vec3 pos(size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+    bool alive(size_t i) const { return (live[i/64] >> (i%64)) & 1; }
+    mt::attractor operator[](size_t i) const { return { pos(i), std::sqrt(dist2[i]), alive(i), node[i] }; }
+
+    void push_back(const glm::vec3& p);
+    void attract(size_t i, int32_t idx, float d2);
+    void kill(size_t i) { live[i/64] &= ~(uint64_t(1) << (i%64)); }
+    void clear();
+
+    std::vector<float> x, y, z;
+    std::vector<float> dist2; // Squared distance to closest node.
+    std::vector<int32_t> node; // Index of closest node.
+    std::vector<uint64_t> live; // Bitset of alive attractors.
+    std::vector<bool> listed; // Attractor is in colony::near.
+  };
+
+  // Node within range of an attractor.
+  struct hit {
+    uint32_t attr_idx;
+    uint32_t node_idx;
+    float dist2;
+  };
+
+  // Scratch buffers of a single worker thread.
+  struct worker {
+    std::vector<uint32_t> found;
+    std::vector<float> dist2;
+    std::vector<mt::hit> hits;
+  };
+
+  // Batch of random points with the scratch space of the samplers.
+  struct samples {
+    void resize(size_t n);
+
+    std::vector<float> x, y, z;
+    std::vector<float> rad, off, ca, sa; // Radius, height, cosine and sine of elevation.
+    std::vector<float> ang, sin, cos; // Azimuth with its sine and cosine.
+  };
+
   struct bark {
     glm::vec3 pos;
     float size;
@@ -47,28 +130,35 @@ namespace mt {
     void step();
 
     // Return i-th parent of node.
-    int parent(size_t id, size_t i) {
-      auto& nd0 = nodes[id];
-      while (i--) {
-        if (nd0.parent_idx == -1) break;
-        nd0 = nodes[nd0.parent_idx];
-      }
-      return nd0.parent_idx;
+    int parent(size_t id, size_t i) const {
+      int p = nodes.parent[id];
+      while (i-- && p != -1)
+        p = nodes.parent[p];
+      return p;
     }
 
-    std::vector<mt::attractor> attr;
-    std::vector<mt::node> nodes;
+    mt::attr_array attr;
+    mt::node_array nodes;
     std::vector<glm::vec3> leaves;
     std::vector<mt::bark> bark;
 
+    mt::grid field; // Live attractors.
+    std::vector<uint32_t> near; // Live attractors with a node in range.
+    std::vector<uint32_t> growing; // Nodes with influence this step.
+    std::vector<mt::worker> workers;
+    mt::pool pool; // Threads of the attract search.
+    mt::samples batch;
 
     void create_envelope();
     void create_roots();
+    void attract(size_t start, size_t end, mt::worker& w);
 
     glm::vec3 cursor;
     size_t attr_alive;
+    size_t attr_dead;
     float iter;
     size_t last;
+    size_t steps; // Growth steps taken.
     bool finished;
     float max_dist;
 
@@ -90,6 +180,10 @@ namespace mt {
     float attr_rad = 0.07f;
     float kill_rad = 0.05f;
     float unit = 0.005f;
+    int threads = 0; // Worker threads, 0 uses all cores.
+    uint32_t seed = 0; // Key of all random streams.
+    size_t max_steps = 0; // Stop growing after this many steps, 0 never.
+    static const size_t step_cap = 2000; // Default max_steps of the tools.
 
     float max_branch_leaves = 0.01f;
     float leaves_top_ppv = 30.f/unit;
@@ -0,0 +1,168 @@
+#include "cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace mt {
+
+  // Layout: header, node x, y, z, parent, tips, leaf xyz, attractor x, y, z
+  // and the live bitset of the attractors.
+  struct tree_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t steps;
+    uint64_t key;
+    uint64_t nodes;
+    uint64_t leaves;
+    uint64_t attr;
+  };
+
+  static const char tree_magic[8] = "mttree";
+  static const uint32_t tree_version = 1;
+
+  // FNV-1a hash.
+  static void mix(uint64_t& h, const void* p, size_t n) {
+    auto c = (const unsigned char*)p;
+    for (size_t i = 0; i < n; ++i) {
+      h ^= c[i];
+      h *= 1099511628211ull;
+    }
+  }
+
+  uint64_t tree_key(const mt::colony& c) {
+    uint64_t h = 1469598103934665603ull;
+    mix(h, &tree_version, sizeof(tree_version));
+    mix(h, &c.seed, sizeof(c.seed));
+    uint64_t steps = c.max_steps;
+    mix(h, &steps, sizeof(steps));
+    const float vals[] = {
+      c.base.x, c.base.y, c.base.z, c.grow_dir.x, c.grow_dir.y, c.grow_dir.z,
+      c.trunk_length, c.trunk_width, c.trunk_ppv, c.env_length, c.env_width, c.env_ppv,
+      c.root_length, c.root_width, c.root_ppv, c.min_branch_size, c.branch_growth_factor,
+      c.attr_rad, c.kill_rad, c.unit, c.max_branch_leaves,
+    };
+    mix(h, vals, sizeof(vals));
+    return h;
+  }
+
+  std::string tree_file(const std::string& dir, const mt::colony& c) {
+    char name[32];
+    snprintf(name, sizeof(name), "tree_%016llx.bin", (unsigned long long)tree_key(c));
+    return dir + name;
+  }
+
+  // Read n elements from f.
+  template <typename T>
+  static bool read(FILE* f, std::vector<T>& v, size_t n) {
+    v.resize(n);
+    return n == 0 || fread(&v[0], sizeof(T), n, f) == n;
+  }
+
+  template <typename T>
+  static bool write(FILE* f, const std::vector<T>& v) {
+    return v.empty() || fwrite(&v[0], sizeof(T), v.size(), f) == v.size();
+  }
+
+  // Return whether every node but the root has an earlier parent, as they
+  // are grown.
+  static bool valid_parents(const std::vector<int32_t>& parent) {
+    if (parent.empty() || parent[0] != -1) return false;
+    for (size_t i = 1; i < parent.size(); ++i)
+      if (parent[i] < 0 || (size_t)parent[i] >= i) return false;
+    return true;
+  }
+
+  // The file is checked against its header and the node links are checked
+  // before they are used as indices; anything off is a miss.
+  bool load_tree(const std::string& dir, mt::colony& c) {
+    FILE* f = fopen(tree_file(dir, c).c_str(), "rb");
+    if (!f) return false;
+    tree_header h;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && fseek(f, 0, SEEK_END) == 0;
+    long size = ok ? ftell(f) : -1;
+    ok = ok && size >= 0 && fseek(f, sizeof(h), SEEK_SET) == 0;
+    if (ok) {
+      // Counts are bounded by the size first so the expected size cannot wrap.
+      uint64_t max = size;
+      size_t words = (h.attr + 63)/64;
+      ok = memcmp(h.magic, tree_magic, sizeof(tree_magic)) == 0 && h.version == tree_version &&
+        h.key == tree_key(c) && h.nodes != 0 && h.nodes <= max && h.leaves <= max && h.attr <= max &&
+        (uint64_t)size == sizeof(h) + h.nodes*(3*sizeof(float) + sizeof(int32_t) + sizeof(uint32_t))
+          + h.leaves*sizeof(glm::vec3) + h.attr*3*sizeof(float) + words*sizeof(uint64_t);
+    }
+
+    auto& n = c.nodes;
+    auto& a = c.attr;
+    ok = ok && read(f, n.x, h.nodes) && read(f, n.y, h.nodes) && read(f, n.z, h.nodes) &&
+      read(f, n.parent, h.nodes) && read(f, n.tips, h.nodes) && read(f, c.leaves, h.leaves) &&
+      read(f, a.x, h.attr) && read(f, a.y, h.attr) && read(f, a.z, h.attr) &&
+      read(f, a.live, (h.attr + 63)/64);
+    fclose(f);
+    if (!ok || !valid_parents(n.parent)) {
+      n.clear();
+      a.clear();
+      c.leaves.clear();
+      return false;
+    }
+
+    // Derived node state.
+    n.tip_width = c.min_branch_size;
+    n.growth = c.branch_growth_factor;
+    n.tip.assign(h.nodes, true);
+    for (size_t i = 0; i < h.nodes; ++i)
+      if (n.parent[i] >= 0) n.tip[n.parent[i]] = false;
+    n.attr_sum.assign(h.nodes, glm::vec3(0.f));
+    n.attr_num.assign(h.nodes, 0);
+
+    a.dist2.assign(h.attr, std::numeric_limits<float>::max());
+    a.node.assign(h.attr, -1);
+    a.listed.assign(h.attr, false);
+    size_t alive = 0;
+    for (size_t i = 0; i < h.attr; ++i)
+      alive += a.alive(i);
+
+    // Finished colony; step() has nothing left to do.
+    c.bark.clear();
+    c.near.clear();
+    c.growing.clear();
+    c.field.reset(c.attr_rad);
+    c.cursor = c.base;
+    c.iter = 0.f;
+    c.attr_alive = alive;
+    c.attr_dead = h.attr - alive;
+    c.last = h.nodes;
+    c.steps = h.steps;
+    c.finished = true;
+    c.max_dist = 0.f;
+    return true;
+  }
+
+  bool save_tree(const std::string& dir, const mt::colony& c) {
+    if (!c.finished) return false;
+    tree_header h;
+    memcpy(h.magic, tree_magic, sizeof(tree_magic));
+    h.version = tree_version;
+    h.steps = c.steps;
+    h.key = tree_key(c);
+    h.nodes = c.nodes.size();
+    h.leaves = c.leaves.size();
+    h.attr = c.attr.size();
+
+    // Write to a temporary file so readers never see a partial tree.
+    std::string file = tree_file(dir, c);
+    std::string tmp = file + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+      write(f, c.nodes.x) && write(f, c.nodes.y) && write(f, c.nodes.z) &&
+      write(f, c.nodes.parent) && write(f, c.nodes.tips) && write(f, c.leaves) &&
+      write(f, c.attr.x) && write(f, c.attr.y) && write(f, c.attr.z) && write(f, c.attr.live);
+    ok = fclose(f) == 0 && ok;
+    if (ok) ok = rename(tmp.c_str(), file.c_str()) == 0;
+    if (!ok) remove(tmp.c_str());
+    return ok;
+  }
+
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "algo.h"
+
+namespace mt {
+
+  // On-disk cache of finished colonies. Files are named after a hash of the
+  // seed and all growth parameters, and are validated when loaded.
+
+  // Return hash of everything that determines the grown colony.
+  uint64_t tree_key(const mt::colony& c);
+
+  // Return path of the cache file of colony in dir.
+  std::string tree_file(const std::string& dir, const mt::colony& c);
+
+  // Load finished colony from cache in dir. Returns false on a miss.
+  bool load_tree(const std::string& dir, mt::colony& c);
+
+  // Save finished colony to cache in dir. Returns success.
+  bool save_tree(const std::string& dir, const mt::colony& c);
+
+}
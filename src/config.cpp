@@ -2,6 +2,10 @@
 
 #include <fstream>
 #include <algorithm>
+#include <cstring>
+
+#include <sys/inotify.h>
+#include <unistd.h>
 
 #include "json.hpp"
 #include "stb_image_write.h"
@@ -13,9 +17,10 @@ namespace mt {
   bool show_nodes = true;
   bool export_png = false;
   bool render_front = false;
+  bool grow_complete = false;
+  bool render_oit = false;
 
   // Structures for tagged union for parameter types.
-  enum var_type { FLOAT, VEC, INT };
   union var {
     float f;
     struct { float x,y,z; } v;
@@ -27,25 +32,31 @@ namespace mt {
     std::string key;
     mt::var_type tag;
     mt::var value, min, max;
+    mt::stage stage;
+    uint64_t version; // Of the last change.
   };
 
   static std::vector<mt::param> atlas; // Atlas of all parameters.
+  static uint64_t last_version = 0; // Last version handed out.
+  static uint64_t stage_version[5]; // Last change of each stage bit.
   static int curr = 0; // Index of current parameter being changed.
   static std::string file_name; // Name of json file.
+  static int watch_fd = -1; // Inotify instance watching conf_dir.
 
   static std::string json_file(const std::string& file) { return file + ".json"; }
   static std::string json_file_path(const std::string& file) { return conf_dir + file + ".json"; }
 
   // Initialize a float parameter.
-  static void init_param(const std::string& key, float val, float min, float max) {
-    mt::param p = { key, FLOAT, val, min, max };
+  static void init_param(mt::stage stage, const std::string& key, float val, float min, float max) {
+    mt::param p = { key, FLOAT, val, min, max, stage };
     atlas.push_back(p);
   }
 
   // Initialize a vec3 parameter.
-  static void init_param(const std::string& key, glm::vec3 val, glm::vec3 min, glm::vec3 max) {
+  static void init_param(mt::stage stage, const std::string& key, glm::vec3 val, glm::vec3 min, glm::vec3 max) {
     mt::param p;
     p.key = key;
+    p.stage = stage;
     p.tag = VEC;
     p.value.v = { val.x, val.y, val.z };
     p.min.v = { min.x, min.y, min.z };
@@ -54,9 +65,10 @@ namespace mt {
   }
 
   // Initialize an int or boolean parameter.
-  static void init_param(const std::string& key, int val, int min = 0, int max = 1) {
+  static void init_param(mt::stage stage, const std::string& key, int val, int min = 0, int max = 1) {
     mt::param p;
     p.key = key;
+    p.stage = stage;
     p.tag = INT;
     p.value.i = val;
     p.min.i = min;
@@ -64,6 +76,40 @@ namespace mt {
     atlas.push_back(p);
   }
 
+  // Record a change of the given stages.
+  static void bump(unsigned stages) {
+    ++last_version;
+    for (unsigned s = 0; s < 5; ++s)
+      if (stages & (1u << s)) stage_version[s] = last_version;
+  }
+
+  // Record a change of a parameter.
+  static void bump(mt::param& p) {
+    bump(p.stage);
+    p.version = last_version;
+  }
+
+  // Return latest version of any of the stages.
+  uint64_t version(unsigned stages) {
+    uint64_t v = 0;
+    for (unsigned s = 0; s < 5; ++s)
+      if (stages & (1u << s)) v = std::max(v, stage_version[s]);
+    return v;
+  }
+
+  // Return version of the last change of a parameter.
+  uint64_t param_version(unsigned id) {
+    return atlas[id].version;
+  }
+
+  // Return whether the stages changed after version seen, and update it.
+  bool changed(unsigned stages, uint64_t& seen) {
+    uint64_t v = version(stages);
+    if (v <= seen) return false;
+    seen = v;
+    return true;
+  }
+
   // Return param in atlas.
   static mt::param* find_param(const std::string& key) {
     auto find_func = [key] (const mt::param& en) { return en.key == key; };
@@ -74,57 +120,117 @@ namespace mt {
       return nullptr;
   }
 
-  // Initialize parameters and load from file if provided.
-  void load_params(const std::string& file) {
-    init_param("g_camera", {0.f, 90.f, 4.f}, {-720.f, 0.1f, -50.f}, {720.f, 180.f, 50.f});
-    init_param("g_height", 0.5f, -10.f, 10.f);
-    init_param("g_seed", 0, 0, 99999);
-    init_param("tree_bark_col_a", {53.f, 70.f, 40.f}, {0.f, 0.f, 0.f}, {100.f, 150.f, 360.f});
-    init_param("tree_bark_col_b", {53.f, 70.f, 40.f}, {0.f, 0.f, 0.f}, {100.f, 150.f, 360.f});
-    init_param("tree_bark_opac", 1.f, 0.f, 10.f);
-    init_param("tree_bark_add", 0.f, 0.f, 1.f);
-    init_param("tree_leaves_col_a", {89.f, 32.f, 128.f}, {0.f, 0.f, 0.f}, {100.f, 150.f, 360.f});
-    init_param("tree_leaves_col_b", {89.f, 32.f, 128.f}, {0.f, 0.f, 0.f}, {100.f, 150.f, 360.f});
-    init_param("tree_leaves_opac", 1.f, 0.f, 10.f);
-    init_param("tree_leaves_add", 0.f, 0.f, 1.f);
-    init_param("tree_leaves_size", 0.003f, 0.f, 0.2f);
-    init_param("tree_attr_col", {50.f, 0.f, 0.f}, {0.f, 0.f, 0.f}, {100.f, 150.f, 360.f});
-    init_param("tree_attr_size", 0.003f, 0.f, 0.2f);
-    init_param("back_bg_col", {1.f, 1.f, 1.f}, {0.f, 0.f, 0.f}, {2.f, 2.f, 2.f});
-    init_param("back_cloud_col", {1.f, 1.f, 1.f}, {0.f, 0.f, 0.f}, {2.f, 2.f, 2.f});
-    init_param("back_cloud_strength", 0.5f, 0.f, 1.f);
-    init_param("back_blur_rad", 1.f, 0.f, 5.f);
-    init_param("back_exposure", 1.f, 0.f, 20.f);
-    init_param("back_waterline", -0.25f, -2.f, 2.f);
-    init_param("back_sun_pos", {-0.2f, 0.3f, 0.f}, {-2.f, -2.f, 0.f}, {2.f, 2.f, 1.f});
-    init_param("back_sun_col", {0.3f, 0.25f, 0.1f}, {0.f, 0.f, 0.f}, {2.f, 2.f, 2.f});
-    init_param("back_sun_radius", 0.03f, 0.001f, 1.f);
-    init_param("back_sun_strength", 0.2f, 0.001f, 5.f);
-    init_param("front_blur_rad", 1.f, 0.f, 5.f);
-    init_param("front_paper_col", {1.f, 1.f, 0.92f}, {0.f, 0.f, 0.f}, {2.f, 2.f, 2.f});
-
-
-    file_name = file;
+  // Read the json file, if there is one and it parses.
+  static bool read_json(nlohmann::json& j) {
     std::ifstream in(json_file_path(file_name));
-    if(!in.fail()) {
-      nlohmann::json j;
+    if (in.fail()) return false;
+    try {
       in >> j;
-      for (auto it = j.begin(); it != j.end(); ++it) {
-        auto p = find_param(it.key());
-        if (!p) continue;
+    } catch (const std::exception& e) {
+      std::cerr << "Can't read '" << json_file(file_name) << "': " << e.what() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Set parameters from json, return stages of the ones that changed.
+  static unsigned merge_json(const nlohmann::json& j) {
+    unsigned stages = 0;
+    for (auto it = j.begin(); it != j.end(); ++it) {
+      auto p = find_param(it.key());
+      if (!p) continue;
+      mt::var val = p->value;
+      try {
         switch (p->tag) {
           case FLOAT:
-            p->value.f = it.value();
+            val.f = it.value();
             break;
           case VEC:
-            p->value.v = { it.value()[0], it.value()[1], it.value()[2] };
+            val.v = { it.value().at(0), it.value().at(1), it.value().at(2) };
             break;
           case INT:
-            p->value.i = it.value();
+            val.i = it.value();
             break;
         }
+      } catch (const std::exception& e) {
+        std::cerr << "Can't read '" << it.key() << "': " << e.what() << std::endl;
+        continue;
+      }
+      if (!memcmp(&val, &p->value, sizeof(val))) continue;
+      p->value = val;
+      bump(*p);
+      stages |= p->stage;
+    }
+    return stages;
+  }
+
+  // Initialize parameters and load from file if provided.
+  void load_params(const std::string& file) {
+    // Atlas order is the order of mt::param_index.
+    atlas.clear();
+#define MT_INIT_F(stage, key, val, min, max) init_param(stage, #key, val, min, max);
+#define MT_INIT_V(stage, key, val, min, max) init_param(stage, #key, glm::vec3 val, glm::vec3 min, glm::vec3 max);
+    MT_PARAMS(MT_INIT_F, MT_INIT_V, MT_INIT_F)
+#undef MT_INIT_F
+#undef MT_INIT_V
+
+    file_name = file;
+    nlohmann::json j;
+    if (read_json(j)) merge_json(j);
+    bump(ALL);
+    for (auto& p : atlas)
+      p.version = last_version;
+
+    // Watch the directory, editors and scripts often replace the file.
+    if (watch_fd < 0) {
+      watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (watch_fd < 0 || inotify_add_watch(watch_fd, conf_dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        std::cerr << "Can't watch '" << conf_dir << "'." << std::endl;
+    }
+  }
+
+  // Merge edits of the json file since the last call. Never blocks; growth
+  // is re-run when a growth parameter changed.
+  void reload_params() {
+    if (watch_fd < 0) return;
+    alignas(inotify_event) char buf[4096];
+    bool edited = false;
+    ssize_t len;
+    while ((len = read(watch_fd, buf, sizeof(buf))) > 0) {
+      for (char* ptr = buf; ptr < buf + len;) {
+        auto ev = (const inotify_event*)ptr;
+        if (ev->len && json_file(file_name) == ev->name) edited = true;
+        ptr += sizeof(inotify_event) + ev->len;
       }
     }
+    if (!edited) return;
+
+    nlohmann::json j;
+    if (!read_json(j)) return;
+    unsigned stages = merge_json(j);
+    if (stages & GROWTH) mt::init = true;
+    if (stages) std::cout << "Reloaded '" << json_file(file_name) << "'." << std::endl;
+  }
+
+  // Declare all parameters as members of uniform block 'param', in atlas
+  // order.
+  std::string param_glsl(unsigned binding) {
+    std::string glsl = "layout(std140, binding = " + std::to_string(binding) + ") uniform params {\n";
+    for (auto& p : atlas)
+      glsl += std::string(p.tag == FLOAT ? "  float " : p.tag == VEC ? "  vec3 " : "  int ") + p.key + ";\n";
+    return glsl + "} param;\n";
+  }
+
+  // Write all parameters in std140 layout, matching param_glsl.
+  void param_std140(std::vector<char>& data) {
+    data.clear();
+    for (auto& p : atlas) {
+      size_t align = p.tag == VEC ? 16 : 4; // Size is 12 or 4.
+      size_t at = (data.size() + align - 1) / align * align;
+      data.resize(at + (p.tag == VEC ? 12 : 4));
+      memcpy(&data[at], &p.value, data.size() - at);
+    }
+    data.resize((data.size() + 15) / 16 * 16);
   }
 
   // Convert parameter atlas to json string.
@@ -176,37 +282,19 @@ namespace mt {
   }
 
   // Get a float parameter.
-  float paramf(const std::string& key) {
-    auto ptr = find_param(key);
-    if (ptr)
-      return ptr->value.f;
-    else {
-      std::cerr << "Can't find entry." << std::endl;
-      return 0.f;
-    }
+  float paramf(mt::param_handle<FLOAT> h) {
+    return atlas[h.id].value.f;
   }
 
   // Get a vec3 parameter.
-  glm::vec3 paramv(const std::string& key) {
-    auto ptr = find_param(key);
-    if (ptr) {
-      auto v = ptr->value.v;
-      return glm::vec3(v.x, v.y, v.z);
-    } else {
-      std::cerr << "Can't find entry." << std::endl;
-      return glm::vec3(0.f);
-    }
+  glm::vec3 paramv(mt::param_handle<VEC> h) {
+    auto v = atlas[h.id].value.v;
+    return glm::vec3(v.x, v.y, v.z);
   }
 
   // Get an int parameter.
-  int parami(const std::string& key) {
-    auto ptr = find_param(key);
-    if (ptr)
-      return ptr->value.i;
-    else {
-      std::cerr << "Can't find entry." << std::endl;
-      return 0;
-    }
+  int parami(mt::param_handle<INT> h) {
+    return atlas[h.id].value.i;
   }
 
   // Print the current parameter being manipulated.
@@ -249,18 +337,22 @@ namespace mt {
         KEY(GLFW_KEY_RIGHT, up_key());
         // Modify previous parameter.
         KEY(GLFW_KEY_LEFT, down_key());
-        // Re-initialize graphics objects.
+        // Re-run invalidated stages.
         KEY(GLFW_KEY_ENTER, mt::init = true);
         // Re-initialize grahpics objects and increment seed.
-        KEY(GLFW_KEY_SPACE, mt::init = true; find_param("g_seed")->value.i++);
+        KEY(GLFW_KEY_SPACE, mt::init = true; atlas[p::g_seed.id].value.i++; bump(atlas[p::g_seed.id]));
         // Show/hide attractors in colonization algo.
-        KEY(GLFW_KEY_A, mt::show_attr = !mt::show_attr);
+        KEY(GLFW_KEY_A, mt::show_attr = !mt::show_attr; bump(STYLE));
         // Show/hide nodes in colonization algo.
-        KEY(GLFW_KEY_N, mt::show_nodes = !mt::show_nodes);
+        KEY(GLFW_KEY_N, mt::show_nodes = !mt::show_nodes; bump(STYLE));
         // Export png file.
         KEY(GLFW_KEY_P, mt::export_png = true);
         // Switch cover sides.
         KEY(GLFW_KEY_TAB, mt::render_front = !mt::render_front);
+        // Only show the tree once it is fully grown.
+        KEY(GLFW_KEY_G, mt::grow_complete = !mt::grow_complete);
+        // Switch between sorted and order-independent transparency.
+        KEY(GLFW_KEY_O, mt::render_oit = !mt::render_oit);
       }
     }
   }
@@ -270,9 +362,14 @@ namespace mt {
     auto& param = atlas[curr];
     if (param.tag == VEC) {
       float unit = (param.max.v.z - param.min.v.z) / 100.f;
-      if (yoffset == 1) param.value.v.z += unit;
-      else if (yoffset == -1) param.value.v.z -= unit;
-      param.value.v.z = glm::clamp(param.value.v.z, param.min.v.z, param.max.v.z);
+      float z = param.value.v.z;
+      if (yoffset == 1) z += unit;
+      else if (yoffset == -1) z -= unit;
+      z = glm::clamp(z, param.min.v.z, param.max.v.z);
+      if (z != param.value.v.z) {
+        param.value.v.z = z;
+        bump(param);
+      }
     }
   }
 
@@ -299,6 +396,7 @@ namespace mt {
   // GLFW drag callback.
   void drag_cb(GLFWwindow* window, double xpos, double ypos) {
     if (start.x > -1) {
+      auto old = atlas[curr].value;
       glm::dvec2 factor = glm::dvec2(xpos-start.x, ypos-start.y);
       factor /= mt::window_size.y;
       switch (param_start.tag) {
@@ -334,12 +432,13 @@ namespace mt {
           break;
         }
       }
+      if (memcmp(&old, &atlas[curr].value, sizeof(old))) bump(atlas[curr]);
     }
   }
 
   // Return camera position.
   glm::vec3 camera() {
-    auto cam = mt::paramv("g_camera");
+    auto cam = mt::paramv(p::g_camera);
     float polar = -glm::radians(cam.x-90.f);
     float azi = glm::radians(cam.y);
     glm::vec3 v = glm::vec3(sin(azi)*cos(polar), cos(azi), sin(azi)*sin(polar));
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -25,12 +28,81 @@ namespace mt {
   const double tau = glm::pi<double>()*2.0;
   const size_t max_atoms = 1000000;
 
+  // Stages of a frame which depend on parameters. Growth is re-run on
+  // Enter, the other stages as soon as one of their parameters changes.
+  enum stage : unsigned {
+    GROWTH = 1 << 0, // Colony.
+    STYLE = 1 << 1, // Atom colours and sizes.
+    VIEW = 1 << 2, // Camera.
+    BACK = 1 << 3, // Back cover shader.
+    POST = 1 << 4, // Blur and front cover.
+    ALL = (1 << 5) - 1
+  };
+
+  // Table of all parameters: stage, key, default, min and max. F, V and I
+  // declare float, vec3 and int parameters; vectors are in parentheses.
+#define MT_PARAMS(F, V, I) \
+  V(VIEW, g_camera, (0.f, 90.f, 4.f), (-720.f, 0.1f, -50.f), (720.f, 180.f, 50.f)) \
+  F(VIEW, g_height, 0.5f, -10.f, 10.f) \
+  I(GROWTH, g_seed, 0, 0, 99999) \
+  V(STYLE, tree_bark_col_a, (53.f, 70.f, 40.f), (0.f, 0.f, 0.f), (100.f, 150.f, 360.f)) \
+  V(STYLE, tree_bark_col_b, (53.f, 70.f, 40.f), (0.f, 0.f, 0.f), (100.f, 150.f, 360.f)) \
+  F(STYLE, tree_bark_opac, 1.f, 0.f, 10.f) \
+  F(STYLE, tree_bark_add, 0.f, 0.f, 1.f) \
+  V(STYLE, tree_leaves_col_a, (89.f, 32.f, 128.f), (0.f, 0.f, 0.f), (100.f, 150.f, 360.f)) \
+  V(STYLE, tree_leaves_col_b, (89.f, 32.f, 128.f), (0.f, 0.f, 0.f), (100.f, 150.f, 360.f)) \
+  F(STYLE, tree_leaves_opac, 1.f, 0.f, 10.f) \
+  F(STYLE, tree_leaves_add, 0.f, 0.f, 1.f) \
+  F(STYLE, tree_leaves_size, 0.003f, 0.f, 0.2f) \
+  V(STYLE, tree_attr_col, (50.f, 0.f, 0.f), (0.f, 0.f, 0.f), (100.f, 150.f, 360.f)) \
+  F(STYLE, tree_attr_size, 0.003f, 0.f, 0.2f) \
+  V(BACK, back_bg_col, (1.f, 1.f, 1.f), (0.f, 0.f, 0.f), (2.f, 2.f, 2.f)) \
+  V(BACK, back_cloud_col, (1.f, 1.f, 1.f), (0.f, 0.f, 0.f), (2.f, 2.f, 2.f)) \
+  F(BACK, back_cloud_strength, 0.5f, 0.f, 1.f) \
+  F(POST, back_blur_rad, 1.f, 0.f, 5.f) \
+  F(BACK, back_exposure, 1.f, 0.f, 20.f) \
+  F(BACK, back_waterline, -0.25f, -2.f, 2.f) \
+  V(BACK, back_sun_pos, (-0.2f, 0.3f, 0.f), (-2.f, -2.f, 0.f), (2.f, 2.f, 1.f)) \
+  V(BACK, back_sun_col, (0.3f, 0.25f, 0.1f), (0.f, 0.f, 0.f), (2.f, 2.f, 2.f)) \
+  F(BACK, back_sun_radius, 0.03f, 0.001f, 1.f) \
+  F(BACK, back_sun_strength, 0.2f, 0.001f, 5.f) \
+  F(POST, front_blur_rad, 1.f, 0.f, 5.f) \
+  V(POST, front_paper_col, (1.f, 1.f, 0.92f), (0.f, 0.f, 0.f), (2.f, 2.f, 2.f))
+
+  // Index of every parameter in the atlas.
+  namespace param_index {
+#define MT_PARAM_INDEX(stage, key, ...) key,
+    enum : unsigned { MT_PARAMS(MT_PARAM_INDEX, MT_PARAM_INDEX, MT_PARAM_INDEX) count };
+#undef MT_PARAM_INDEX
+  }
+
+  // Typed handle of a parameter.
+  enum var_type { FLOAT, VEC, INT };
+  template <mt::var_type T>
+  struct param_handle {
+    unsigned id;
+  };
+
+  // Handles of all parameters, e.g. mt::paramf(mt::p::g_height). Unknown
+  // keys and type mismatches fail to compile.
+  namespace p {
+#define MT_PARAM_F(stage, key, ...) constexpr param_handle<FLOAT> key = { param_index::key };
+#define MT_PARAM_V(stage, key, ...) constexpr param_handle<VEC> key = { param_index::key };
+#define MT_PARAM_I(stage, key, ...) constexpr param_handle<INT> key = { param_index::key };
+    MT_PARAMS(MT_PARAM_F, MT_PARAM_V, MT_PARAM_I)
+#undef MT_PARAM_F
+#undef MT_PARAM_V
+#undef MT_PARAM_I
+  }
+
   // Global variables.
   extern bool init;
   extern bool show_attr;
   extern bool show_nodes;
   extern bool export_png;
   extern bool render_front;
+  extern bool grow_complete;
+  extern bool render_oit;
 
   // Callbacks.
   void key_cb(GLFWwindow* window, int key, int scancode, int action, int mods);
@@ -40,10 +112,24 @@ namespace mt {
 
   // Edit/load/get json parameters.
   void load_params(const std::string& file);
+  void reload_params();
   void save_params();
-  float paramf(const std::string& key);
-  glm::vec3 paramv(const std::string& key);
-  int parami(const std::string& key);
+  float paramf(mt::param_handle<FLOAT> h);
+  glm::vec3 paramv(mt::param_handle<VEC> h);
+  int parami(mt::param_handle<INT> h);
+
+  // Uniform block of all parameters as GLSL, and its std140 contents.
+  std::string param_glsl(unsigned binding);
+  void param_std140(std::vector<char>& data);
+
+  // Versions of parameter changes. Every change of a parameter, or of a flag
+  // read by a stage, takes the next version. Consumers remember the version
+  // they last saw and skip their work until their stages changed since.
+  uint64_t version(unsigned stages);
+  uint64_t param_version(unsigned id);
+  template <mt::var_type T>
+  uint64_t version(mt::param_handle<T> h) { return param_version(h.id); }
+  bool changed(unsigned stages, uint64_t& seen);
 
   // Utils.
   glm::vec3 camera();
@@ -7,6 +7,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
 
 #define STR(s) #s
 
@@ -95,6 +97,14 @@ namespace gl {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   }
 
+  void fbo::enable(std::initializer_list<GLenum> targets) {
+    std::vector<GLenum> b(targets);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboID);
+    glDrawBuffers(b.size(), b.data());
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  }
+
   void fbo::enable_all() {
     GLenum b[] = {
       GL_COLOR_ATTACHMENT0,
@@ -121,91 +131,373 @@ namespace gl {
     return attachments[target];
   }
 
+  ring::ring():
+    id(0),
+    map(nullptr),
+    size(0),
+    head(0) {
+  }
+
+  ring::~ring() {
+    for (auto f : fences)
+      if (f) glDeleteSync(f);
+    if (id) glDeleteBuffers(1, &id);
+  }
+
+  // Allocate and map count regions of at least bytes each.
+  void ring::alloc(size_t bytes, size_t count) {
+    GLint align;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align);
+    size = (std::max<size_t>(bytes, 1) + align - 1) / align * align;
+    fences.assign(count, nullptr);
+    head = 0;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, size*count, nullptr, flags);
+    map = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size*count, flags | GL_MAP_FLUSH_EXPLICIT_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  // Advance to the next region once the GPU stopped reading it.
+  char* ring::next() {
+    head = (head + 1) % fences.size();
+    if (GLsync f = fences[head]) {
+      while (glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+      glDeleteSync(f);
+      fences[head] = nullptr;
+    }
+    return map + head*size;
+  }
+
+  // Make a written span of the current region visible to the GPU.
+  void ring::flush(size_t offset, size_t len) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glFlushMappedBufferRange(GL_COPY_WRITE_BUFFER, head*size + offset, len);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  void ring::bind(GLenum target, GLuint index) {
+    glBindBufferRange(target, index, id, head*size, size);
+  }
+
+  // Mark the current region as in use by the commands issued so far.
+  void ring::fence() {
+    if (fences[head]) glDeleteSync(fences[head]);
+    fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  static std::vector<shader*> loaded; // Shaders loaded from files.
+  std::string shader::prelude;
+  std::string shader::cache_dir;
+  static int watch_fd = -1; // Inotify instance watching the glsl directory.
+
   shader::shader():
     programID(0),
+    pending(0),
+    pending_vert(0),
+    pending_frag(0),
+    pending_key(0),
     tex_unit(0) {
   }
 
-  void shader::load_file(const std::string& vertex_file_path, const std::string& fragment_file_path) {
+  shader::~shader() {
+    loaded.erase(std::remove(loaded.begin(), loaded.end(), this), loaded.end());
+    if (pending) glDeleteProgram(pending);
+    glDeleteShader(pending_vert);
+    glDeleteShader(pending_frag);
+    glDeleteProgram(programID);
+  }
 
-    // Create the shaders
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Read the Vertex Shader code from the file
-    std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-    if(VertexShaderStream.is_open()){
-      std::string Line = "";
-      while(getline(VertexShaderStream, Line))
-        VertexShaderCode += "\n" + Line;
-      VertexShaderStream.close();
-    }else{
-      std::cout << "Impossible to open " << vertex_file_path << ". Are you in the right directory?" << std::endl;
-      return;
+  // Read a whole file, or return false if it can't be opened.
+  static bool read_file(const std::string& path, std::string& code) {
+    std::ifstream stream(path, std::ios::in);
+    if (!stream.is_open()) {
+      std::cout << "Impossible to open " << path << ". Are you in the right directory?" << std::endl;
+      return false;
     }
+    std::string line = "";
+    code.clear();
+    while (getline(stream, line))
+      code += "\n" + line;
+    return true;
+  }
 
-    // Read the Fragment Shader code from the file
-    std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    if(FragmentShaderStream.is_open()){
-      std::string Line = "";
-      while(getline(FragmentShaderStream, Line))
-        FragmentShaderCode += "\n" + Line;
-      FragmentShaderStream.close();
+  // Print the info log of a shader or program, if it has one.
+  static void print_log(GLuint id, bool program) {
+    if (!id) return;
+    int length = 0;
+    if (program) glGetProgramiv(id, GL_INFO_LOG_LENGTH, &length);
+    else glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+    if (length <= 0) return;
+    std::vector<char> message(length+1);
+    if (program) glGetProgramInfoLog(id, length, NULL, &message[0]);
+    else glGetShaderInfoLog(id, length, NULL, &message[0]);
+    printf("%s\n", &message[0]);
+  }
+
+  // Insert the prelude after the #version line, keeping line numbers of the
+  // code after it.
+  static void add_prelude(std::string& code) {
+    if (shader::prelude.empty()) return;
+    size_t pos = code.find("#version");
+    if (pos == std::string::npos) return;
+    pos = code.find('\n', pos);
+    if (pos == std::string::npos) return;
+    ++pos;
+    size_t line = std::count(code.begin(), code.begin() + pos, '\n') + 1;
+    code.insert(pos, shader::prelude + "#line " + std::to_string(line) + "\n");
+  }
+
+  // Header of a cached program binary.
+  struct binary_header {
+    char magic[8];
+    uint64_t key;
+    uint32_t format;
+    uint32_t size;
+  };
+
+  static const char binary_magic[8] = "mtprog";
+
+  // FNV-1a hash.
+  static void mix(uint64_t& h, const void* p, size_t n) {
+    auto c = (const unsigned char*)p;
+    for (size_t i = 0; i < n; ++i) {
+      h ^= c[i];
+      h *= 1099511628211ull;
     }
+  }
 
-    GLint Result = GL_FALSE;
-    int InfoLogLength;
+  // Return hash of the sources and the driver they are compiled by.
+  static uint64_t program_key(const std::string& vert, const std::string& frag) {
+    uint64_t h = 1469598103934665603ull;
+    for (GLenum e : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION }) {
+      auto s = (const char*)glGetString(e);
+      if (s) mix(h, s, strlen(s) + 1);
+    }
+    mix(h, vert.c_str(), vert.size() + 1);
+    mix(h, frag.c_str(), frag.size() + 1);
+    return h;
+  }
 
-    // Compile Vertex Shader
-    char const * VertexSourcePointer = VertexShaderCode.c_str();
-    glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-    glCompileShader(VertexShaderID);
-
-    // Check Vertex Shader
-    glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
-      std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-      glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-      printf("%s\n", &VertexShaderErrorMessage[0]);
+  // Return cache file of the program built from a pair of files. It is named
+  // after the paths rather than the sources, so a reload overwrites the
+  // previous binary instead of adding one; the header holds the source key.
+  static std::string binary_file(const std::string& vert_path, const std::string& frag_path) {
+    uint64_t h = 1469598103934665603ull;
+    mix(h, vert_path.c_str(), vert_path.size() + 1);
+    mix(h, frag_path.c_str(), frag_path.size() + 1);
+    char name[32];
+    snprintf(name, sizeof(name), "prog_%016llx.bin", (unsigned long long)h);
+    return shader::cache_dir + name;
+  }
+
+  // Return whether the driver can hand out program binaries at all.
+  static bool binaries_supported() {
+    if (shader::cache_dir.empty()) return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+  }
+
+  // Return program from the cached binary in file, or 0 on a miss or if the
+  // driver rejects it, e.g. after an update. A size that does not match the
+  // file length is a miss too.
+  static GLuint load_binary(const std::string& file, uint64_t key) {
+    if (!binaries_supported()) return 0;
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f) return 0;
+    binary_header h;
+    std::vector<char> data;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && !memcmp(h.magic, binary_magic, sizeof(binary_magic)) && h.key == key;
+    if (ok) {
+      long at = ftell(f);
+      ok = fseek(f, 0, SEEK_END) == 0 && ftell(f) - at == (long)h.size && fseek(f, at, SEEK_SET) == 0;
+    }
+    if (ok) {
+      data.resize(h.size);
+      ok = fread(data.data(), 1, data.size(), f) == data.size();
+    }
+    fclose(f);
+    if (!ok) return 0;
+
+    GLuint id = glCreateProgram();
+    glProgramBinary(id, h.format, data.data(), data.size());
+    GLint linked = GL_FALSE;
+    glGetProgramiv(id, GL_LINK_STATUS, &linked);
+    if (linked) return id;
+    glDeleteProgram(id);
+    return 0;
+  }
+
+  // Save binary of a linked program to file. A temporary file keeps readers
+  // from seeing a partial one.
+  static void save_binary(const std::string& file, uint64_t key, GLuint id) {
+    if (!binaries_supported()) return;
+    GLint size = 0;
+    glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) return;
+    std::vector<char> data(size);
+    binary_header h;
+    memcpy(h.magic, binary_magic, sizeof(binary_magic));
+    h.key = key;
+    h.size = size;
+    glGetProgramBinary(id, size, nullptr, &h.format, data.data());
+
+    std::string tmp = file + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = fclose(f) == 0 && ok;
+    // Not every platform's rename replaces an existing file.
+    if (ok) remove(file.c_str());
+    if (ok) ok = rename(tmp.c_str(), file.c_str()) == 0;
+    if (!ok) remove(tmp.c_str());
+  }
+
+  // Compile and link a program from files, waiting for the result.
+  void shader::load_file(const std::string& vertex_file_path, const std::string& fragment_file_path) {
+    vert_path = vertex_file_path;
+    frag_path = fragment_file_path;
+    if (std::find(loaded.begin(), loaded.end(), this) == loaded.end())
+      loaded.push_back(this);
+    reload();
+    finish();
+  }
+
+  // Start compiling and linking the files again. With parallel shader
+  // compilation this returns before the driver is done.
+  void shader::reload() {
+    std::string VertexShaderCode, FragmentShaderCode;
+    if (!read_file(vert_path, VertexShaderCode) || !read_file(frag_path, FragmentShaderCode))
+      return;
+    add_prelude(VertexShaderCode);
+    add_prelude(FragmentShaderCode);
+
+    // A newer edit supersedes a compile that is still running.
+    if (pending) glDeleteProgram(pending);
+    glDeleteShader(pending_vert);
+    glDeleteShader(pending_frag);
+    pending_vert = pending_frag = 0;
+
+    // Use the driver's binary of the same sources if it still accepts it.
+    pending_key = program_key(VertexShaderCode, FragmentShaderCode);
+    if ((pending = load_binary(binary_file(vert_path, frag_path), pending_key))) {
+      pending_key = 0;
+      return;
     }
 
-    // Compile Fragment Shader
+    pending_vert = glCreateShader(GL_VERTEX_SHADER);
+    char const * VertexSourcePointer = VertexShaderCode.c_str();
+    glShaderSource(pending_vert, 1, &VertexSourcePointer , NULL);
+    glCompileShader(pending_vert);
+
+    pending_frag = glCreateShader(GL_FRAGMENT_SHADER);
     char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-    glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-    glCompileShader(FragmentShaderID);
-
-    // Check Fragment Shader
-    glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
-      std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-      glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-      printf("%s\n", &FragmentShaderErrorMessage[0]);
+    glShaderSource(pending_frag, 1, &FragmentSourcePointer , NULL);
+    glCompileShader(pending_frag);
+
+    pending = glCreateProgram();
+    glAttachShader(pending, pending_vert);
+    glAttachShader(pending, pending_frag);
+    if (!cache_dir.empty())
+      glProgramParameteri(pending, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(pending);
+  }
+
+  // Swap in the pending program once it is linked. Without waiting, return
+  // false while the driver is still busy. A program that fails to build is
+  // dropped with its logs printed, the previous one stays in use.
+  bool shader::finish(bool wait) {
+    if (!pending) return false;
+    GLint Result = GL_FALSE;
+    if (!wait && GLEW_KHR_parallel_shader_compile) {
+      glGetProgramiv(pending, GL_COMPLETION_STATUS_KHR, &Result);
+      if (!Result) return false;
     }
 
-    // Link the program
-    programID = glCreateProgram();
-    glAttachShader(programID, VertexShaderID);
-    glAttachShader(programID, FragmentShaderID);
-    glLinkProgram(programID);
+    print_log(pending_vert, false);
+    print_log(pending_frag, false);
+    print_log(pending, true);
+    glGetProgramiv(pending, GL_LINK_STATUS, &Result);
+
+    if (pending_vert) glDetachShader(pending, pending_vert);
+    if (pending_frag) glDetachShader(pending, pending_frag);
+    glDeleteShader(pending_vert);
+    glDeleteShader(pending_frag);
+    pending_vert = pending_frag = 0;
+
+    bool linked = Result == GL_TRUE;
+    if (linked && pending_key) save_binary(binary_file(vert_path, frag_path), pending_key, pending);
+    if (linked || !programID) {
+      glDeleteProgram(programID);
+      programID = pending;
+      cache_locations();
+    } else {
+      std::cerr << "Keeping previous program of " << vert_path << " and " << frag_path << "." << std::endl;
+      glDeleteProgram(pending);
+    }
+    pending = 0;
+    return linked;
+  }
 
-    // Check the program
-    glGetProgramiv(programID, GL_LINK_STATUS, &Result);
-    glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if ( InfoLogLength > 0 ){
-      std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-      glGetProgramInfoLog(programID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-      printf("%s\n", &ProgramErrorMessage[0]);
+  // Cache the locations of all active uniforms, arrays also by plain name.
+  void shader::cache_locations() {
+    uniforms.clear();
+    GLint count = 0, length = 0;
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+    std::vector<char> name(length+1);
+    for (GLint i = 0; i < count; ++i) {
+      GLint size;
+      GLenum type;
+      glGetActiveUniform(programID, i, length, nullptr, &size, &type, &name[0]);
+      GLint loc = glGetUniformLocation(programID, &name[0]);
+      if (loc == -1) continue; // Member of a uniform block.
+      std::string key(&name[0]);
+      uniforms[key] = loc;
+      if (key.size() > 3 && key.compare(key.size()-3, 3, "[0]") == 0)
+        uniforms[key.substr(0, key.size()-3)] = loc;
     }
+  }
+
+  // Return cached location of a uniform, or -1 if it isn't active.
+  GLint shader::location(const char* name) {
+    auto it = uniforms.find(name);
+    return it == uniforms.end() ? -1 : it->second;
+  }
 
-    glDetachShader(programID, VertexShaderID);
-    glDetachShader(programID, FragmentShaderID);
+  void shader::watch(const std::string& dir) {
+    if (GLEW_KHR_parallel_shader_compile)
+      glMaxShaderCompilerThreadsKHR(0xffffffff); // As many as the driver likes.
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0 || inotify_add_watch(watch_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+      std::cerr << "Can't watch '" << dir << "'." << std::endl;
+  }
+
+  // Return whether path names the file name in its last component.
+  static bool same_file(const std::string& path, const char* name) {
+    size_t slash = path.find_last_of('/');
+    return path.compare(slash == std::string::npos ? 0 : slash+1, std::string::npos, name) == 0;
+  }
 
-    glDeleteShader(VertexShaderID);
-    glDeleteShader(FragmentShaderID);
+  // Start compiles for sources edited since the last call and swap in the
+  // programs that finished. Never blocks.
+  void shader::reload_changed() {
+    alignas(inotify_event) char buf[4096];
+    ssize_t len;
+    while (watch_fd >= 0 && (len = read(watch_fd, buf, sizeof(buf))) > 0) {
+      for (char* ptr = buf; ptr < buf + len;) {
+        auto ev = (const inotify_event*)ptr;
+        for (auto sh : loaded)
+          if (ev->len && (same_file(sh->vert_path, ev->name) || same_file(sh->frag_path, ev->name)))
+            sh->reload();
+        ptr += sizeof(inotify_event) + ev->len;
+      }
+    }
+    for (auto sh : loaded)
+      if (sh->finish(false)) std::cout << "Reloaded " << sh->frag_path << "." << std::endl;
   }
 
   //For some very frustrating reason, I cannot declare a global string and manually
@@ -246,41 +538,42 @@ namespace gl {
     
     glDeleteShader(vertexID);
     glDeleteShader(fragmentID);
+    cache_locations();
 
   }
 
   void shader::uniform(const char* name, const glm::mat3& m) {
-  GLint i = glGetUniformLocation(programID, name);
+    GLint i = location(name);
     if(i == -1) std::cerr << "Uniform '" << name << "' not found." << std::endl;
     glUniformMatrix3fv(i, 1, GL_FALSE, &m[0][0]);
   }
 
   void shader::uniform(const char* name, const glm::mat4& m) {
-  GLint i = glGetUniformLocation(programID, name);
+    GLint i = location(name);
     if(i == -1) std::cerr << "Uniform '" << name << "' not found." << std::endl;
     glUniformMatrix4fv(i, 1, GL_FALSE, &m[0][0]);
   }
 
   void shader::uniform(const char* name, float x) {
-    GLint i = glGetUniformLocation(programID, name);
+    GLint i = location(name);
     if(i == -1) std::cerr << "Uniform '" << name << "' not found." << std::endl;
     glUniform1f(i, x);
   }
 
   void shader::uniform(const char* name, float x, float y) {
-    GLint i = glGetUniformLocation(programID, name);
+    GLint i = location(name);
     if(i == -1) std::cerr << "Uniform '" << name << "' not found." << std::endl;
     glUniform2f(i, x, y);
   }
 
   void shader::uniform(const char* name, float x, float y, float z) {
-    GLint i = glGetUniformLocation(programID, name);
+    GLint i = location(name);
     if(i == -1) std::cerr << "Uniform '" << name << "' not found." << std::endl;
     glUniform3f(i, x, y, z);
   }
 
   void shader::uniform(const char* name, float x, float y, float z, float w) {
-    GLint i = glGetUniformLocation(programID, name);
+    GLint i = location(name);
     if(i == -1) std::cerr << "Uniform '" << name << "' not found." << std::endl;
     glUniform4f(i, x, y, z, w);
   }
@@ -298,7 +591,7 @@ namespace gl {
   }
 
   void shader::uniformui(const char* name, unsigned int x) {
-    GLint i = glGetUniformLocation(programID, name);
+    GLint i = location(name);
     if(i == -1) std::cerr << "Uniform '" << name << "' not found." << std::endl;
     glUniform1ui(i, x);
   }
@@ -310,7 +603,7 @@ namespace gl {
   }
 
   void shader::texture(const char* name, GLuint id) {
-    GLint i = glGetUniformLocation(programID, name);
+    GLint i = location(name);
     if(i == -1) std::cerr << "Texture '" << name << "' not found." << std::endl;
     glActiveTexture(GL_TEXTURE0 + tex_unit);
     glBindTexture(GL_TEXTURE_2D, id);
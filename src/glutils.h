@@ -2,8 +2,10 @@
 #include <GL/glew.h>
 
 #include <string>
+#include <cstdint>
 #include <vector>
 #include <map>
+#include <initializer_list>
 
 #include <glm/glm.hpp>
 
@@ -22,6 +24,7 @@ namespace gl {
     void attach(GLenum target, GLenum format, int w, int h, bool clamp = false);
 
     void enable(GLenum target = GL_COLOR_ATTACHMENT0);
+    void enable(std::initializer_list<GLenum> targets);
     void enable_all();
     void disable();
 
@@ -32,12 +35,38 @@ namespace gl {
     std::map<GLenum, GLuint> attachments;
   };
 
+  // Persistently mapped buffer of a few regions written round robin. Each
+  // region is fenced once drawn from and only rewritten when the GPU is done.
+  class ring {
+  public:
+    ring();
+    ~ring();
+    void alloc(size_t bytes, size_t count = 3);
+
+    char* next();
+    void flush(size_t offset, size_t len);
+    void bind(GLenum target, GLuint index);
+    void fence();
+
+    size_t region() const { return head; }
+    size_t regions() const { return fences.size(); }
+
+  private:
+    GLuint id;
+    char* map;
+    size_t size; // Bytes per region.
+    size_t head; // Region being written and drawn.
+    std::vector<GLsync> fences;
+  };
+
   // Wrapper for a GLSL shader program.
   class shader {
   public:
     shader();
-    ~shader() { glDeleteProgram(programID); }
+    ~shader();
     void load_file(const std::string& vertex_file_path, const std::string& fragment_file_path);
+    void reload();
+    bool finish(bool wait = true);
     void load(const std::string& fragment_shader_code, 
       const std::string& vertex_shader_code = basic_vert_shader);
 
@@ -59,9 +88,23 @@ namespace gl {
     void enable();
     void disable();
 
+    // Watch dir and recompile programs whose sources change there.
+    static void watch(const std::string& dir);
+    static void reload_changed();
+
+    static std::string prelude; // Inserted after the #version of every file.
+    static std::string cache_dir; // Of linked program binaries, off if empty.
+
   private:
+    GLint location(const char* name);
+    void cache_locations();
+
     GLuint programID;
-    std::map<std::string, GLuint> uniforms;
+    GLuint pending; // Program being compiled, swapped in once linked.
+    GLuint pending_vert, pending_frag;
+    uint64_t pending_key; // Binary cache key of a program compiled from source.
+    std::string vert_path, frag_path;
+    std::map<std::string, GLint> uniforms; // Locations, cached when linked.
     int tex_unit;
 
     static const std::string glsl_version_header;
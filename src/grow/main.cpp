@@ -0,0 +1,176 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+
+#include "algo.h"
+#include "json.hpp"
+
+// Headless tree generation. Grows colonies without a display and writes
+// their nodes and leaves to text files.
+
+// Options shared by all trees.
+struct options {
+  nlohmann::json conf; // Optional "colony" overrides.
+  size_t max_steps = mt::colony::step_cap;
+  std::string prefix = "tree";
+};
+
+static void usage(const char* prg) {
+  std::cerr << "Usage: " << prg << " [-s SEED[:LAST]] [-j JOBS] [-n STEPS] [-o PREFIX] [FILE]\n"
+    << "  FILE    json config, name in data/ or path (seed from g_seed)\n"
+    << "  -s      seed or inclusive range of seeds to sweep\n"
+    << "  -j      trees grown in parallel, default all cores\n"
+    << "  -n      maximum growth steps, default 2000\n"
+    << "  -o      output prefix, writes PREFIX_SEED.txt\n";
+  exit(EXIT_FAILURE);
+}
+
+// Load json config, either a path or a name in data/ as for cover.
+static nlohmann::json load(const std::string& file) {
+  std::string path = file;
+  if (path.find('/') == std::string::npos && path.find(".json") == std::string::npos)
+    path = "data/" + path + ".json";
+
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Cannot open '" << path << "'" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  nlohmann::json j;
+  in >> j;
+  return j;
+}
+
+// Apply growth parameters from the "colony" object of the config.
+static void configure(mt::colony& c, const nlohmann::json& conf) {
+  if (conf.find("colony") == conf.end()) return;
+  const auto& j = conf["colony"];
+  struct field { const char* key; float* val; };
+  field fields[] = {
+    { "trunk_length", &c.trunk_length }, { "trunk_width", &c.trunk_width },
+    { "trunk_ppv", &c.trunk_ppv }, { "env_length", &c.env_length },
+    { "env_width", &c.env_width }, { "env_ppv", &c.env_ppv },
+    { "root_length", &c.root_length }, { "root_width", &c.root_width },
+    { "root_ppv", &c.root_ppv }, { "min_branch_size", &c.min_branch_size },
+    { "branch_growth_factor", &c.branch_growth_factor }, { "attr_rad", &c.attr_rad },
+    { "kill_rad", &c.kill_rad }, { "unit", &c.unit },
+    { "max_branch_leaves", &c.max_branch_leaves },
+  };
+  for (auto it = j.begin(); it != j.end(); ++it) {
+    bool found = false;
+    for (auto& f : fields) {
+      if (it.key() == f.key) {
+        *f.val = it.value().get<float>();
+        found = true;
+      }
+    }
+    if (!found) std::cerr << "Unknown colony parameter '" << it.key() << "'" << std::endl;
+  }
+}
+
+// Write nodes (position, width, parent) and leaves (position) of colony.
+static bool write(const std::string& file, const mt::colony& c) {
+  std::ofstream out(file);
+  if (!out) return false;
+  out.precision(9);
+  out << "# cover-grow seed " << c.seed << " steps " << c.steps
+    << (c.max_steps && c.steps >= c.max_steps ? " capped" : "") << "\n";
+  out << "nodes " << c.nodes.size() << "\n";
+  for (size_t i = 0; i < c.nodes.size(); ++i) {
+    auto n = c.nodes[i];
+    out << n.pos.x << " " << n.pos.y << " " << n.pos.z << " " << n.size << " " << n.parent_idx << "\n";
+  }
+  out << "leaves " << c.leaves.size() << "\n";
+  for (size_t i = 0; i < c.leaves.size(); ++i)
+    out << c.leaves[i].x << " " << c.leaves[i].y << " " << c.leaves[i].z << "\n";
+  return bool(out);
+}
+
+// Grow tree of seed to completion and write it. Returns success.
+static bool grow(uint32_t seed, int threads, const options& opt, std::mutex& log) {
+  mt::colony c;
+  configure(c, opt.conf);
+  c.seed = seed;
+  c.threads = threads;
+  c.max_steps = opt.max_steps;
+
+  c.init();
+  while (!c.finished)
+    c.step();
+
+  std::string file = opt.prefix + "_" + std::to_string(seed) + ".txt";
+  bool ok = write(file, c);
+  std::lock_guard<std::mutex> lock(log);
+  if (ok)
+    std::cout << "Seed " << seed << ": " << c.nodes.size() << " nodes, " << c.leaves.size()
+      << " leaves in " << c.steps << " steps -> '" << file << "'" << std::endl;
+  else
+    std::cerr << "Seed " << seed << ": cannot write '" << file << "'" << std::endl;
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  options opt;
+  long first = -1, last = -1;
+  int jobs = 0;
+  std::string file;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool val = i + 1 < argc;
+    if (arg == "-s" && val) {
+      std::string s = argv[++i];
+      auto colon = s.find(':');
+      first = std::atol(s.substr(0, colon).c_str());
+      last = colon == std::string::npos ? first : std::atol(s.substr(colon + 1).c_str());
+    } else if (arg == "-j" && val) {
+      jobs = std::atoi(argv[++i]);
+    } else if (arg == "-n" && val) {
+      opt.max_steps = std::atol(argv[++i]);
+    } else if (arg == "-o" && val) {
+      opt.prefix = argv[++i];
+    } else if (arg[0] != '-' && file.empty()) {
+      file = arg;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (!file.empty()) {
+    opt.conf = load(file);
+    if (first < 0 && opt.conf.find("g_seed") != opt.conf.end())
+      first = last = opt.conf["g_seed"].get<int>();
+  }
+  if (first < 0) first = last = 0;
+  if (last < first) usage(argv[0]);
+
+  // Sweeps grow one tree per worker; a single tree uses all cores itself.
+  size_t count = last - first + 1;
+  if (jobs <= 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+  jobs = std::min<size_t>(jobs, count);
+  int threads = count == 1 ? 0 : 1;
+
+  std::atomic<size_t> next(0);
+  std::atomic<bool> ok(true);
+  std::mutex log;
+  auto work = [&]() {
+    size_t k;
+    while ((k = next++) < count)
+      if (!grow(first + k, threads, opt, log)) ok = false;
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 1; t < jobs; ++t)
+    pool.emplace_back(work);
+  work();
+  for (auto& t : pool)
+    t.join();
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,74 @@
+#include "grower.h"
+
+#include "cache.h"
+
+namespace mt {
+
+  void grower::start(const mt::colony& c, const std::string& dir) {
+    stop();
+    colony = c;
+    cache_dir = dir;
+    quit = false;
+    taken = true;
+    std::atomic_store(&current, std::shared_ptr<const mt::snapshot>());
+    worker = std::thread(&grower::run, this);
+  }
+
+  void grower::stop() {
+    quit = true;
+    if (worker.joinable()) worker.join();
+  }
+
+  std::shared_ptr<const mt::snapshot> grower::latest() {
+    taken = true;
+    return std::atomic_load(&current);
+  }
+
+  // Grow until finished. Intermediate snapshots are only made once the
+  // previous one has been read, so copying is paced by the reader while
+  // growth is not.
+  void grower::run() {
+    if (!cache_dir.empty() && mt::load_tree(cache_dir, colony)) {
+      publish();
+      return;
+    }
+
+    colony.init();
+    while (!quit && !colony.finished) {
+      colony.step();
+      if (!complete && taken) publish();
+    }
+    if (quit) return;
+
+    publish();
+    if (!cache_dir.empty()) mt::save_tree(cache_dir, colony);
+  }
+
+  // Copy colony into a new snapshot and swap it in.
+  void grower::publish() {
+    auto snap = std::make_shared<mt::snapshot>();
+    size_t n = colony.nodes.size();
+    snap->nodes.resize(n);
+    snap->widths.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      snap->nodes[i] = colony.nodes.pos(i);
+      snap->widths[i] = colony.nodes.width(i);
+    }
+
+    size_t a = colony.attr.size();
+    snap->attr.resize(a);
+    snap->alive.resize(a);
+    for (size_t i = 0; i < a; ++i) {
+      snap->attr[i] = colony.attr.pos(i);
+      snap->alive[i] = colony.attr.alive(i);
+    }
+
+    snap->leaves = colony.leaves;
+    snap->steps = colony.steps;
+    snap->finished = colony.finished;
+
+    taken = false;
+    std::atomic_store(&current, std::shared_ptr<const mt::snapshot>(snap));
+  }
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#include <glm/glm.hpp>
+
+#include "algo.h"
+
+namespace mt {
+
+  // Immutable copy of a colony, published by the grower.
+  struct snapshot {
+    std::vector<glm::vec3> nodes;
+    std::vector<float> widths;
+    std::vector<glm::vec3> attr;
+    std::vector<bool> alive;
+    std::vector<glm::vec3> leaves;
+    size_t steps = 0;
+    bool finished = false;
+  };
+
+  // Grows a colony on a worker thread, as fast as it can, and publishes
+  // snapshots of it. The latest snapshot can be read from any thread without
+  // locking or waiting for a step.
+  class grower {
+  public:
+    grower(): complete(false), quit(false), taken(true) {}
+    ~grower() { stop(); }
+
+    // Stop growing and start over with a copy of colony. Finished trees are
+    // loaded from and saved to the tree cache in dir, if one is given.
+    void start(const mt::colony& c, const std::string& dir = "");
+    void stop();
+
+    // Return latest snapshot, or null if there is none yet.
+    std::shared_ptr<const mt::snapshot> latest();
+
+    std::atomic<bool> complete; // Only publish the finished colony.
+
+  private:
+    void run();
+    void publish();
+
+    mt::colony colony;
+    std::string cache_dir;
+    std::thread worker;
+    std::atomic<bool> quit;
+    std::atomic<bool> taken; // Latest snapshot has been read.
+    std::shared_ptr<const mt::snapshot> current; // Only use atomic access.
+  };
+
+}
@@ -47,6 +47,7 @@ int main(int argc, char *argv[]) {
   // GLEW setup.
   glewExperimental = true; // Needed for core profile.
   assert(glewInit() == GLEW_OK);
+  assert(GLEW_ARB_buffer_storage); // Persistently mapped atom buffers.
 
   // Global OpenGL settings.
   glEnable(GL_BLEND);
@@ -57,39 +58,51 @@ int main(int argc, char *argv[]) {
   // Buffer for reading raw pixels.
   std::vector<char> buffer(mt::window_size.x * mt::window_size.y * 4);
 
-  // Graphics objects.
+  // Graphics objects. Their shaders are recompiled when edited and all
+  // declare the parameter buffer.
+  gl::shader::watch(mt::glsl_dir);
+  gl::shader::prelude = mt::param_glsl(mt::param_buffer::binding);
+  gl::shader::cache_dir = mt::conf_dir;
+  mt::param_buffer params;
   mt::data data(mt::max_atoms);
   mt::tree tree(&data);
   mt::back back;
   mt::front front;
   mt::blur blur;
   mt::blur blur2;
+  uint64_t grown = 0; // Growth version of the tree.
 
   // Render loop.
   while (!glfwWindowShouldClose(window)) {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    mt::reload_params(); // Pick up edits of the json file.
+    gl::shader::reload_changed();
+    params.update();
     if (mt::init) {
-      std::srand(mt::parami("g_seed")); // Set seed for reproducability.
-      tree.init();
-      data.init();
+      // Only regrow when a growth parameter changed.
+      if (mt::changed(mt::GROWTH, grown)) {
+        tree.init();
+        data.init();
+      }
       mt::init = false;
     }
 
     // Draw objects.
     blur.enable();
     tree.step();
+    if (!mt::render_oit) data.sort(); // OIT needs no order.
     data.send();
     blur.disable();
-    blur.process(mt::paramf("back_blur_rad"));
+    blur.process(mt::paramf(mt::p::back_blur_rad));
 
     if (mt::render_front) blur2.enable();
     back.draw(blur.id());
     if (mt::render_front) {
       blur2.disable();
-      blur2.process(mt::paramf("front_blur_rad"));
-      blur2.process(mt::paramf("front_blur_rad"));
-      blur2.process(mt::paramf("front_blur_rad"));
-      blur2.process(mt::paramf("front_blur_rad"));
+      blur2.process(mt::paramf(mt::p::front_blur_rad));
+      blur2.process(mt::paramf(mt::p::front_blur_rad));
+      blur2.process(mt::paramf(mt::p::front_blur_rad));
+      blur2.process(mt::paramf(mt::p::front_blur_rad));
       front.draw(blur2.id());
     }
 
@@ -1,6 +1,9 @@
 #include "objects.h"
 
 #include <algorithm>
+#include <array>
+#include <thread>
+#include <cstring>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/random.hpp>
@@ -8,11 +11,19 @@
 namespace mt {
 
   // Data constructor.
-  data::data(size_t num): total_num(num), alive_num(0) {
+  data::data(size_t num): upload(1), rotation(false), rotated(false), sort_view(0), view(0), total_num(num), alive_num(0) {
     glGenVertexArrays(1, &vao_id);
-    glGenBuffers(2, vbo_ids);
+    glGenBuffers(1, &vbo_id);
+    atoms.alloc(sizeof(gpu_atom)*num);
+    synced.assign(atoms.regions(), 0);
+    pages.resize((num >> page_bits) + 1);
 
     shader.load_file(glsl_dir + "quad.vert", glsl_dir + "sprite.frag");
+    oit_shader.load_file(glsl_dir + "quad.vert", glsl_dir + "oit.frag");
+    resolve.load_file(glsl_dir + "pass.vert", glsl_dir + "resolve.frag");
+    oit.attach(GL_COLOR_ATTACHMENT0, GL_RGBA16F, (int)mt::window_size.x, (int)mt::window_size.y);
+    oit.attach(GL_COLOR_ATTACHMENT1, GL_R16F, (int)mt::window_size.x, (int)mt::window_size.y);
+    oit.attach(GL_COLOR_ATTACHMENT2, GL_RGBA16F, (int)mt::window_size.x, (int)mt::window_size.y);
     buffer.resize(num);
     order.resize(num);
     init();
@@ -21,40 +32,19 @@ namespace mt {
 
     // Allocate static quad vertices for billboarding.
     const GLuint quad_loc = 0;
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_ids[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_id);
     glBufferData(GL_ARRAY_BUFFER, sizeof(gl::quad::verts), gl::quad::verts, GL_STATIC_DRAW);
     glEnableVertexAttribArray(quad_loc);
     glVertexAttribPointer(quad_loc, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_ids[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(atom)*num, nullptr, GL_STREAM_DRAW);
-
-    const GLuint pos_loc = 1;
-    glEnableVertexAttribArray(pos_loc);
-    glVertexAttribPointer(pos_loc, 4, GL_FLOAT, GL_FALSE, sizeof(atom), (void*)(offsetof(atom, _pos)));
-    glVertexAttribDivisor(pos_loc, 1);
-
-    const GLuint cola_loc = 2;
-    glEnableVertexAttribArray(cola_loc);
-    glVertexAttribPointer(cola_loc, 4, GL_FLOAT, GL_FALSE, sizeof(atom), (void*)(offsetof(atom, _cola)));
-    glVertexAttribDivisor(cola_loc, 1);
-
-    const GLuint colb_loc = 3;
-    glEnableVertexAttribArray(colb_loc);
-    glVertexAttribPointer(colb_loc, 4, GL_FLOAT, GL_FALSE, sizeof(atom), (void*)(offsetof(atom, _colb)));
-    glVertexAttribDivisor(colb_loc, 1);
-
-    const GLuint attr_loc = 4;
-    glEnableVertexAttribArray(attr_loc);
-    glVertexAttribPointer(attr_loc, 4, GL_FLOAT, GL_FALSE, sizeof(atom), (void*)(offsetof(atom, _attr)));
-    glVertexAttribDivisor(attr_loc, 1);
-
-    const GLuint dir_loc = 5;
-    glEnableVertexAttribArray(dir_loc);
-    glVertexAttribPointer(dir_loc, 4, GL_FLOAT, GL_FALSE, sizeof(atom), (void*)(offsetof(atom, _dir)));
-    glVertexAttribDivisor(dir_loc, 1);
-
     glBindVertexArray(0);
+
+    // Directions are only allocated once rotation is used.
+    const glm::uvec2 no_dir(0);
+    glGenBuffers(1, &no_dirs);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, no_dirs);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(no_dir), &no_dir, GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
   }
 
   // Initialize buffer data.
@@ -65,68 +55,265 @@ namespace mt {
       buffer[i].id = i;
       order[i] = i;
     }
+    scratch.clear();
+    stale = true;
+    std::fill(pages.begin(), pages.end(), upload);
+    changed = true;
   }
 
   // Data destructor.
   data::~data() {
-    glDeleteBuffers(2, vbo_ids);
+    glDeleteBuffers(1, &vbo_id);
+    glDeleteBuffers(1, &no_dirs);
     glDeleteVertexArrays(1, &vao_id);
   }
 
+  // Quantize x in [0, max] to 8 bits.
+  static uint32_t unorm8(float x, float max) {
+    return (uint32_t)std::round(glm::clamp(x/max, 0.f, 1.f)*255.f);
+  }
+
+  // Opacity in steps of 1/25 up to 10.2, so that 1 is exact.
+  static uint32_t opacity8(float x) {
+    return (uint32_t)std::round(glm::clamp(x, 0.f, 10.2f)*25.f);
+  }
+
+  // Pack atom, see quad.vert for the unpacking. Mixed colours go up to twice
+  // the parameter range; hue wraps around.
+  void gpu_atom::pack(const mt::atom& a) {
+    pos_xy = glm::packHalf2x16(glm::vec2(a._pos.x, a._pos.y));
+    pos_zs = glm::packHalf2x16(glm::vec2(a._pos.z, a._pos.w));
+    float hue = a._cola.z - 360.f*std::floor(a._cola.z/360.f);
+    col = unorm8(a._cola.x, 200.f) | unorm8(a._cola.y, 300.f) << 8 |
+      ((uint32_t)std::round(hue*256.f/360.f) & 0xff) << 16 | opacity8(a._cola.w) << 24;
+    attr = unorm8(a._colb.w, 1.f) | ((uint32_t)a._attr.x & 0xff) << 8 |
+      ((uint32_t)a._attr.y & 0xffff) << 16;
+  }
+
+  // Pack the alive atoms of pages modified after upload since into the
+  // next ring region, flushing each run of pages as one span. The direction
+  // ring advances along with the atoms only while rotation is on.
+  void data::upload_pages() {
+    auto* dst = (gpu_atom*)atoms.next();
+    auto* dq = rotation ? (glm::uvec2*)dirs.next() : nullptr;
+    uint64_t since = synced[atoms.region()];
+    for (size_t p = 0; p < pages.size();) {
+      if (pages[p] <= since) { ++p; continue; }
+      size_t begin = p << page_bits;
+      while (p < pages.size() && pages[p] > since) ++p;
+      size_t end = std::min(p << page_bits, alive_num);
+      if (begin >= end) continue;
+
+      for (size_t i = begin; i < end; ++i)
+        dst[i].pack(buffer[i]);
+      atoms.flush(begin*sizeof(gpu_atom), (end - begin)*sizeof(gpu_atom));
+      if (!rotation) continue;
+      for (size_t i = begin; i < end; ++i) {
+        auto& q = buffer[i]._dir;
+        dq[i] = glm::uvec2(glm::packHalf2x16(glm::vec2(q.x, q.y)), glm::packHalf2x16(glm::vec2(q.z, q.w)));
+      }
+      dirs.flush(begin*sizeof(glm::uvec2), (end - begin)*sizeof(glm::uvec2));
+    }
+    synced[atoms.region()] = upload++;
+  }
+
   // Send data to GPU and render.
   void data::send() {
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_ids[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(atom)*alive_num, &buffer[0], GL_STREAM_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Directions are only kept up to date while they are used, so turning
+    // rotation on re-packs everything.
+    if (rotation && !rotated) {
+      if (!dirs.regions()) dirs.alloc(sizeof(glm::uvec2)*total_num);
+      std::fill(pages.begin(), pages.end(), upload);
+      changed = true;
+    }
+    rotated = rotation;
+    if (changed) {
+      upload_pages();
+      changed = false;
+    }
+    atoms.bind(GL_SHADER_STORAGE_BUFFER, 0);
+    if (rotation) dirs.bind(GL_SHADER_STORAGE_BUFFER, 1);
+    else glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, no_dirs);
+
+    if (!mt::render_oit) {
+      draw(shader);
+      atoms.fence();
+      if (rotation) dirs.fence();
+      return;
+    }
 
-    float h = mt::paramf("g_height");
-    auto mv = glm::lookAt(mt::camera(), glm::vec3(0.f, h, 0.f), glm::vec3(0.f, 1.f, 0.f));
+    // Accumulate into the OIT buffers, starting fully revealed.
+    GLint target;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+    oit.enable({ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 });
+    const GLfloat one[] = { 1.f, 1.f, 1.f, 1.f };
+    glClearBufferfv(GL_COLOR, 1, one);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+    glBlendFunci(2, GL_ONE, GL_ONE);
+    draw(oit_shader);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Resolve on top of the previous target.
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    resolve.enable();
+    resolve.texture("accum", oit.get_ID(GL_COLOR_ATTACHMENT0));
+    resolve.texture("reveal", oit.get_ID(GL_COLOR_ATTACHMENT1));
+    resolve.texture("added", oit.get_ID(GL_COLOR_ATTACHMENT2));
+    gl::quad::draw(0, 0, mt::window_size.x, mt::window_size.y);
+    resolve.disable();
+    atoms.fence();
+    if (rotation) dirs.fence();
+  }
 
-    float ratio = mt::window_size.x/mt::window_size.y;
-    auto proj = glm::perspective(glm::pi<float>()*0.15f, ratio, 0.1f, 100.f);
+  // Draw all atoms with shader.
+  void data::draw(gl::shader& sh) {
+    if (mt::changed(mt::VIEW, view)) {
+      float h = mt::paramf(mt::p::g_height);
+      mv = glm::lookAt(mt::camera(), glm::vec3(0.f, h, 0.f), glm::vec3(0.f, 1.f, 0.f));
 
-    shader.enable();
-    shader.uniform("mv", mv);
-    shader.uniform("proj", proj);
-    shader.uniformui("rotation", false);
+      float ratio = mt::window_size.x/mt::window_size.y;
+      proj = glm::perspective(glm::pi<float>()*0.15f, ratio, 0.1f, 100.f);
+    }
+
+    sh.enable();
+    sh.uniform("mv", mv);
+    sh.uniform("proj", proj);
+    sh.uniformui("rotation", rotation);
     glBindVertexArray(vao_id);
     glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, alive_num);
     glBindVertexArray(0);
-    shader.disable();
+    sh.disable();
+  }
+
+  // Minimum number of atoms per sorting thread.
+  static const size_t min_sort_work = 1 << 16;
+
+  // Digits of the depth radix sort.
+  static const int radix_bits = 11;
+  static const size_t radix = 1 << radix_bits;
+
+  // Run func(t, begin, end) on count threads of pool over [0, n).
+  template <typename F>
+  static void parallel(mt::pool& pool, size_t count, size_t n, F func) {
+    pool.run(count, [&](size_t t) { func(t, n*t/count, n*(t+1)/count); });
   }
 
-  // Do k iterations of bubble sort.
-  void data::bsort(size_t k) {
-    if (alive_num < 2) return;
+  // Sort atoms back to front. Keys are the bits of the squared distance to
+  // the camera, which order like the floats themselves; they are radix sorted
+  // with their indices and the atoms are permuted once. Nothing is moved if
+  // the atoms are still in order, and nothing is done at all if neither the
+  // atoms nor the camera changed.
+  void data::sort() {
+    size_t n = alive_num;
+    bool moved = mt::changed(mt::VIEW, sort_view);
+    if (n < 2 || (!stale && !moved)) return;
+    stale = false;
     auto cam = mt::camera();
+    size_t count = std::max(1u, std::thread::hardware_concurrency());
+    count = std::max<size_t>(1, std::min(count, n/min_sort_work));
+
+    keys.resize(n);
+    keys_tmp.resize(n);
+    index.resize(n);
+    index_tmp.resize(n);
+    std::vector<char> sorted(count);
+    parallel(sorters, count, n, [&](size_t t, size_t begin, size_t end) {
+      bool in_order = true;
+      for (size_t i = begin; i < end; ++i) {
+        auto d = buffer[i].pos() - cam;
+        float d2 = glm::dot(d, d);
+        uint32_t bits;
+        memcpy(&bits, &d2, sizeof(bits));
+        keys[i] = ~bits; // Furthest first.
+        index[i] = i;
+        if (i > begin && keys[i] < keys[i-1]) in_order = false;
+      }
+      sorted[t] = in_order;
+    });
 
-    while (k--) {
-      bool done = true;
-      for (size_t i = 1; i < alive_num; ++i) {
-        auto& p0 = buffer[i-1];
-        auto& p1 = buffer[i];
-        if (glm::distance(p0.pos(), cam) < glm::distance(p1.pos(), cam)) {
-          std::swap(p0, p1);
-          std::swap(order[p0.id], order[p1.id]);
-          done = false;
+    bool in_order = true;
+    for (size_t t = 0; t < count; ++t) {
+      size_t begin = n*t/count;
+      if (!sorted[t] || (t > 0 && keys[begin] < keys[begin-1])) in_order = false;
+    }
+    if (in_order) return;
+
+    // Stable LSD radix sort, 11 bits per pass. Each thread scatters its own
+    // range to offsets following all lower digits and lower threads.
+    std::vector<std::array<uint32_t, radix>> hist(count);
+    for (int shift = 0; shift < 32; shift += radix_bits) {
+      parallel(sorters, count, n, [&](size_t t, size_t begin, size_t end) {
+        hist[t].fill(0);
+        for (size_t i = begin; i < end; ++i)
+          hist[t][(keys[i] >> shift) & (radix-1)]++;
+      });
+
+      // Skip pass if all keys share this digit.
+      bool same = false;
+      for (size_t d = 0; d < radix && !same; ++d) {
+        size_t sum = 0;
+        for (size_t t = 0; t < count; ++t)
+          sum += hist[t][d];
+        same = sum == n;
+      }
+      if (same) continue;
+
+      uint32_t sum = 0;
+      for (size_t d = 0; d < radix; ++d) {
+        for (size_t t = 0; t < count; ++t) {
+          uint32_t c = hist[t][d];
+          hist[t][d] = sum;
+          sum += c;
         }
       }
-      if (done) return;
+
+      parallel(sorters, count, n, [&](size_t t, size_t begin, size_t end) {
+        auto& off = hist[t];
+        for (size_t i = begin; i < end; ++i) {
+          uint32_t k = off[(keys[i] >> shift) & (radix-1)]++;
+          keys_tmp[k] = keys[i];
+          index_tmp[k] = index[i];
+        }
+      });
+      keys.swap(keys_tmp);
+      index.swap(index_tmp);
     }
+
+    // Permute atoms once into scratch and swap. Atoms past n are never
+    // moved, so both buffers hold the same ones there.
+    if (scratch.size() != buffer.size()) scratch = buffer;
+    parallel(sorters, count, n, [&](size_t t, size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        scratch[i] = buffer[index[i]];
+        order[scratch[i].id] = i;
+      }
+    });
+    buffer.swap(scratch);
+
+    // Only slots that received another atom need uploading.
+    for (size_t i = 0; i < n; ++i)
+      if (index[i] != i) touch(i);
   }
 
   tree::tree(mt::data* d):
     nodes(d),
     attr(d),
-    leaves(d) {
+    leaves(d),
+    styled(0) {
   }
 
   void tree::init() {
-    colony.init();
+    colony.seed = mt::parami(mt::p::g_seed); // Set seed for reproducability.
+    colony.max_steps = mt::colony::step_cap; // Some seeds never stop growing.
+    grower.start(colony, mt::conf_dir);
+    shown.reset();
 
     nodes.clear();
     attr.clear();
     leaves.clear();
+    bark_mix.clear();
+    leaf_mix.clear();
   }
 
   static float hashf(float n) {
@@ -137,61 +324,101 @@ namespace mt {
     return hashf(glm::dot(v, v));
   }
 
-  static glm::vec3 cmix(const glm::vec3& a, const glm::vec3& b, float i, float p = 1.f) {
-    i = glm::pow(glm::clamp(i, 0.f, 1.f), p);
-    return a + i*b;
-  }
-
-  static float fmix(float a, float b, float i, float p = 1.f) {
-    i = glm::pow(glm::clamp(i, 0.f, 1.f), p);
-    return a + i*b;
+  // Shape a random number in [0, 1] into a mix factor.
+  static float shape(float i, float p = 1.f) {
+    return glm::pow(glm::clamp(i, 0.f, 1.f), p);
   }
 
   void tree::step() {
-    colony.step();
-
-    // Attractors.
-    attr.alloc(colony.attr.size());
+    // Growth runs on its own thread; show whatever it has published.
+    grower.complete = mt::grow_complete;
+    // Atoms are only written for a new snapshot or changed style. A style
+    // change restyles everything, otherwise only what grew or changed since
+    // the shown snapshot is written.
+    auto snap = grower.latest();
+    bool restyle = mt::changed(mt::STYLE, styled);
+    if (!snap || (snap == shown && !restyle)) return;
+    auto prev = shown;
+    shown = snap;
+
+    // Attractors never move, they only die.
+    auto attr_size = mt::show_attr ? 0.004f : 0.f;
+    size_t old = attr.len();
+    attr.alloc(snap->attr.size());
     for (size_t i = 0; i < attr.len(); ++i) {
+      bool fresh = i >= old;
+      if (!fresh && !restyle && snap->alive[i] == prev->alive[i]) continue;
       auto& atr = attr[i];
-      atr.pos(colony.attr[i].pos);
-      atr.cola(colony.attr[i].alive ? glm::vec3(80.f, 0.f, 0.f) : glm::vec3(30.f, 30.f, 30.f));
-      atr.size(mt::show_attr ? 0.004f : 0.f);
+      if (fresh) atr.pos(snap->attr[i]);
+      atr.cola(snap->alive[i] ? glm::vec3(80.f, 0.f, 0.f) : glm::vec3(30.f, 30.f, 30.f));
+      atr.size(attr_size);
     }
 
-    // Nodes.
-    nodes.alloc(colony.nodes.size());
+    // Nodes never move, they only get wider.
+    auto bark_a = mt::paramv(mt::p::tree_bark_col_a);
+    auto bark_b = mt::paramv(mt::p::tree_bark_col_b);
+    auto bark_opac = mt::paramf(mt::p::tree_bark_opac);
+    auto bark_add = mt::paramf(mt::p::tree_bark_add);
+    nodes.alloc(snap->nodes.size());
     for (size_t i = 0; i < nodes.len(); ++i) {
+      bool fresh = i >= bark_mix.size();
+      float width = mt::show_nodes ? snap->widths[i] : 0.f;
+      if (!fresh && !restyle) {
+        if (snap->widths[i] != prev->widths[i]) nodes[i].size(width);
+        continue;
+      }
       auto& nd = nodes[i];
-      nd.pos(colony.nodes[i].pos);
-      float prn = hashv(nd.pos());
-      auto a = mt::paramv("tree_bark_col_a");
-      auto b = mt::paramv("tree_bark_col_b");
-      nd.cola(cmix(a, b, prn, 1.f));
-      nd.size(mt::show_nodes ? colony.nodes[i].size : 0.f);
-      nd.opac(mt::paramf("tree_bark_opac"));
-      nd.add(mt::paramf("tree_bark_add"));
+      if (fresh) {
+        nd.pos(snap->nodes[i]);
+        bark_mix.push_back(shape(hashv(nd.pos())));
+      }
+      nd.cola(bark_a + bark_mix[i]*bark_b);
+      nd.size(width);
+      nd.opac(bark_opac);
+      nd.add(bark_add);
     }
 
-    // Leaves.
-    leaves.alloc(colony.leaves.size());
-    for (size_t i = 0; i < leaves.len(); ++i) {
+    // Leaves only appear.
+    auto leaves_a = mt::paramv(mt::p::tree_leaves_col_a);
+    auto leaves_b = mt::paramv(mt::p::tree_leaves_col_b);
+    auto leaves_size = mt::paramf(mt::p::tree_leaves_size);
+    auto leaves_opac = mt::paramf(mt::p::tree_leaves_opac);
+    auto leaves_add = mt::paramf(mt::p::tree_leaves_add);
+    leaves.alloc(snap->leaves.size());
+    for (size_t i = restyle ? 0 : leaf_mix.size(); i < leaves.len(); ++i) {
       auto& lv = leaves[i];
-      lv.pos(colony.leaves[i]);
-      float prn = hashv(lv.pos());
-      auto a = mt::paramv("tree_leaves_col_a");
-      auto b = mt::paramv("tree_leaves_col_b");
-      lv.cola(cmix(a, b, prn, 1.f));
-      auto s = mt::paramf("tree_leaves_size");
-      prn = hashv(lv.pos() + glm::vec3(0.2253f));
-      lv.size(fmix(0.5f*s, 3.f*s, prn, 2.5f));
-      lv.opac(mt::paramf("tree_leaves_opac"));
-      lv.add(mt::paramf("tree_leaves_add"));
+      if (i >= leaf_mix.size()) {
+        lv.pos(snap->leaves[i]);
+        leaf_mix.push_back(glm::vec2(shape(hashv(lv.pos())), shape(hashv(lv.pos() + glm::vec3(0.2253f)), 2.5f)));
+      }
+      lv.cola(leaves_a + leaf_mix[i].x*leaves_b);
+      lv.size(0.5f*leaves_size + leaf_mix[i].y*(3.f*leaves_size));
+      lv.opac(leaves_opac);
+      lv.add(leaves_add);
     }
   }
 
+  // Parameter buffer constructor.
+  param_buffer::param_buffer(): seen(0) {
+    glGenBuffers(1, &ubo);
+  }
+
+  param_buffer::~param_buffer() {
+    glDeleteBuffers(1, &ubo);
+  }
+
+  // Upload parameters if any changed since the last upload.
+  void param_buffer::update() {
+    if (!mt::changed(mt::ALL, seen)) return;
+    mt::param_std140(data);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, data.size(), data.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+  }
+
   // Back object constructor.
-  back::back() {
+  back::back(): program(0) {
     shader.load_file(glsl_dir + "pass.vert", glsl_dir + "back.frag");
     canvas.attach(GL_COLOR_ATTACHMENT0, GL_RGBA16F, (int)mt::window_size.x, (int)mt::window_size.y);
   }
@@ -199,16 +426,12 @@ namespace mt {
   // Draw back cover.
   void back::draw(GLuint id) {
     shader.enable();
-    shader.uniform("window", mt::window_size);
-    shader.uniform("sky_col", mt::paramv("back_bg_col"));
-    shader.uniform("sun_pos", mt::paramv("back_sun_pos"));
-    shader.uniform("sun_col", mt::paramv("back_sun_col"));
-    shader.uniform("cloud_col", mt::paramv("back_cloud_col"));
-    shader.uniform("cloud_strength", mt::paramf("back_cloud_strength"));
-    shader.uniform("sun_radius", mt::paramf("back_sun_radius"));
-    shader.uniform("sun_strength", mt::paramf("back_sun_strength"));
-    shader.uniform("waterline", mt::paramf("back_waterline"));
-    shader.uniform("exposure", mt::paramf("back_exposure"));
+    // Parameters are in the parameter buffer; the window only needs setting
+    // once per program.
+    if (shader.ID() != program) {
+      program = shader.ID();
+      shader.uniform("window", mt::window_size);
+    }
     shader.texture("tex", id);
     gl::quad::draw(0, 0, mt::window_size.x, mt::window_size.y);
     shader.disable();
@@ -255,15 +478,17 @@ namespace mt {
   }
 
   // Front object constructor.
-  front::front() {
+  front::front(): program(0) {
     shader.load_file(glsl_dir + "pass.vert", glsl_dir + "front.frag");
   }
 
   // Draw front cover.
   void front::draw(GLuint id) {
     shader.enable();
-    shader.uniform("window", mt::window_size);
-    shader.uniform("paper_col", mt::paramv("front_paper_col"));
+    if (shader.ID() != program) {
+      program = shader.ID();
+      shader.uniform("window", mt::window_size);
+    }
     shader.texture("tex", id);
     gl::quad::draw(0, 0, mt::window_size.x, mt::window_size.y);
     shader.disable();
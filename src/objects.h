@@ -9,6 +9,8 @@
 #include "glutils.h"
 #include "config.h"
 #include "algo.h"
+#include "grower.h"
+#include "pool.h"
 
 namespace mt {
 
@@ -42,6 +44,18 @@ namespace mt {
     void dir(const glm::quat& q) { _dir.x = q.x; _dir.y = q.y; _dir.z = q.z; _dir.w = q.w; }
   };
 
+  // Packed atom as stored on the GPU, see quad.vert. Position and size are
+  // half floats, colour is 8-bit cylindrical Lab with opacity. The second
+  // colour is not read by any shader and is dropped.
+  struct gpu_atom {
+    uint32_t pos_xy;
+    uint32_t pos_zs; // Z and size.
+    uint32_t col; // L, C, h, opacity.
+    uint32_t attr; // Additivity, type, 16-bit seed.
+
+    void pack(const mt::atom& a);
+  };
+
   // Forward declaration.
   class block;
 
@@ -53,19 +67,43 @@ namespace mt {
 
     void init();
     void send();
-    void bsort(size_t k = 1);
+    void sort();
+    void draw(gl::shader& sh);
+    void upload_pages();
+    void touch(size_t i) { pages[i >> page_bits] = upload; changed = true; }
 
     friend mt::block;
 
   /* private: */
     std::vector<mt::atom> buffer;
     std::vector<size_t> order;
+    std::vector<uint32_t> keys, keys_tmp; // Quantized depth of atoms.
+    std::vector<uint32_t> index, index_tmp; // Atoms in sorted order.
+    std::vector<mt::atom> scratch;
+    mt::pool sorters; // Threads of the depth sort.
+    static const size_t page_bits = 8; // Atoms per page of dirty tracking.
+    std::vector<uint64_t> pages; // Upload that last modified each page.
+    std::vector<uint64_t> synced; // Upload each ring region is up to date with.
+    uint64_t upload; // Number of the next upload.
+    bool rotation; // Rotate billboards by atom direction.
+    bool rotated; // Rotation as of the last send.
+    bool stale; // Atoms changed since last sort.
+    bool changed; // Atoms changed since last upload.
+    uint64_t sort_view; // View version of last sort.
+    uint64_t view; // View version of the matrices.
+    glm::mat4 mv, proj;
     size_t total_num;
     size_t alive_num;
 
     gl::shader shader;
+    gl::shader oit_shader; // Weighted blended transparency.
+    gl::shader resolve;
+    gl::fbo oit; // Accumulation, revealage and additive light.
     GLuint vao_id;
-    GLuint vbo_ids[2];
+    GLuint vbo_id; // Quad vertices.
+    gl::ring atoms; // Packed atoms.
+    gl::ring dirs; // Half float quaternions, allocated on first rotation.
+    GLuint no_dirs; // Bound in place of dirs while rotation is off.
   };
 
   // A 'projection' into the data buffer.
@@ -74,9 +112,19 @@ namespace mt {
     block(mt::data* d = nullptr): ptr(d) {}
     ~block() {}
 
-    void alloc(size_t num) { while (len() < num) index.push_back(ptr->alive_num++); }
+    void alloc(size_t num) {
+      while (len() < num) {
+        ptr->touch(ptr->order[ptr->alive_num]);
+        index.push_back(ptr->alive_num++);
+      }
+    }
     size_t len() const { return index.size(); }
-    mt::atom& operator[](size_t i) { return ptr->buffer[ptr->order[index[i]]]; }
+    mt::atom& operator[](size_t i) {
+      ptr->stale = true;
+      size_t j = ptr->order[index[i]];
+      ptr->touch(j);
+      return ptr->buffer[j];
+    }
     void clear() { index.clear(); }
 
   private:
@@ -96,7 +144,28 @@ namespace mt {
     mt::block nodes;
     mt::block attr;
     mt::block leaves;
-    mt::colony colony;
+    mt::colony colony; // Growth parameters.
+    mt::grower grower;
+    std::shared_ptr<const mt::snapshot> shown; // Snapshot in blocks.
+    std::vector<float> bark_mix; // Colour mix of each node, fixed at creation.
+    std::vector<glm::vec2> leaf_mix; // Colour and size mix of each leaf.
+    uint64_t styled; // Style version of the atoms.
+  };
+
+  // Uniform buffer mirroring the parameter atlas, declared in every shader
+  // by the shader prelude.
+  class param_buffer {
+  public:
+    param_buffer();
+    ~param_buffer();
+    void update();
+
+    static const GLuint binding = 0;
+
+  private:
+    GLuint ubo;
+    uint64_t seen; // Parameter version of the buffer.
+    std::vector<char> data;
   };
 
   // Back cover shader step.
@@ -108,6 +177,7 @@ namespace mt {
   private:
     gl::shader shader;
     gl::fbo canvas;
+    GLuint program; // Program the uniforms were set in.
   };
 
   // Front cover shader step.
@@ -119,6 +189,7 @@ namespace mt {
   private:
     gl::shader shader;
     gl::fbo canvas;
+    GLuint program; // Program the uniforms were set in.
   };
 
   // Gaussian blur object.
@@ -0,0 +1,55 @@
+#include "pool.h"
+
+namespace mt {
+
+  pool::~pool() {
+    {
+      std::lock_guard<std::mutex> l(lock);
+      quit = true;
+    }
+    start.notify_all();
+    for (auto& t : threads)
+      t.join();
+  }
+
+  void pool::run(size_t count, const std::function<void(size_t)>& func) {
+    if (count <= 1) {
+      if (count) func(0);
+      return;
+    }
+
+    // Threads started here pick up the job below as their first.
+    std::unique_lock<std::mutex> l(lock);
+    while (threads.size() < count - 1)
+      threads.emplace_back(&pool::work, this, threads.size() + 1);
+    job = &func;
+    tasks = count;
+    pending = threads.size();
+    round++;
+    l.unlock();
+    start.notify_all();
+
+    func(0);
+    l.lock();
+    done.wait(l, [this] { return pending == 0; });
+    job = nullptr;
+  }
+
+  // Run task t of every job until the pool is destroyed.
+  void pool::work(size_t t) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> l(lock);
+    for (;;) {
+      start.wait(l, [&] { return quit || round != seen; });
+      if (quit) return;
+      seen = round;
+      if (t < tasks) {
+        l.unlock();
+        (*job)(t);
+        l.lock();
+      }
+      if (--pending == 0) done.notify_one();
+    }
+  }
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+namespace mt {
+
+  // Persistent worker threads that run one parallel job at a time. Threads
+  // are started on first use and kept until the pool is destroyed. Copies
+  // start out without threads of their own.
+  class pool {
+  public:
+    pool(): job(nullptr), tasks(0), pending(0), round(0), quit(false) {}
+    pool(const pool&): pool() {}
+    pool& operator=(const pool&) { return *this; }
+    ~pool();
+
+    // Run func(t) for t in [0, count) and return once all are done. Task 0
+    // runs on the calling thread.
+    void run(size_t count, const std::function<void(size_t)>& func);
+
+  private:
+    void work(size_t t);
+
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable start, done;
+    const std::function<void(size_t)>* job;
+    size_t tasks; // Tasks of the current job.
+    size_t pending; // Workers still running the current job.
+    uint64_t round; // Number of jobs started.
+    bool quit;
+  };
+
+}
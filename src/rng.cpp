@@ -0,0 +1,39 @@
+#include "rng.h"
+
+namespace mt {
+
+  // Sample 'index' of 'stream' starts at counter block zero.
+  rng::rng(uint32_t seed, uint32_t stream, uint64_t index):
+    key{ seed, 0x85a308d3u },
+    ctr{ (uint32_t)index, (uint32_t)(index >> 32), 0, stream },
+    used(4) {
+  }
+
+  // Return next 32 random bits.
+  uint32_t rng::next() {
+    if (used == 4) {
+      uint32_t c[4] = { ctr[0], ctr[1], ctr[2], ctr[3] };
+      uint32_t k[2] = { key[0], key[1] };
+      for (int r = 0; r < 10; ++r) {
+        uint64_t p0 = (uint64_t)0xD2511F53u * c[0];
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * c[2];
+        uint32_t n[4] = {
+          (uint32_t)(p1 >> 32) ^ c[1] ^ k[0], (uint32_t)p1,
+          (uint32_t)(p0 >> 32) ^ c[3] ^ k[1], (uint32_t)p0 };
+        c[0] = n[0]; c[1] = n[1]; c[2] = n[2]; c[3] = n[3];
+        k[0] += 0x9E3779B9u;
+        k[1] += 0xBB67AE85u;
+      }
+      out[0] = c[0]; out[1] = c[1]; out[2] = c[2]; out[3] = c[3];
+      ctr[2]++;
+      used = 0;
+    }
+    return out[used++];
+  }
+
+  // Uniform float in [0, 1).
+  float rng::uniform() {
+    return (next() >> 8) * (1.f/16777216.f);
+  }
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+namespace mt {
+
+  // Counter-based random number generator (Philox4x32-10). Every draw is a
+  // pure function of seed, stream, sample index and draw number, so samples
+  // can be generated in any order or on any thread.
+  class rng {
+  public:
+    rng(uint32_t seed, uint32_t stream, uint64_t index);
+
+    uint32_t next();
+    float uniform();
+    float uniform(float a, float b) { return a + (b - a)*uniform(); }
+
+  private:
+    uint32_t key[2];
+    uint32_t ctr[4];
+    uint32_t out[4];
+    int used;
+  };
+
+  // Random streams of the generators in the colony.
+  enum rng_stream : uint32_t { ENVELOPE, ROOTS, LEAVES };
+
+}
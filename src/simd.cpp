@@ -0,0 +1,236 @@
+#include "simd.h"
+
+// The scalar path must round like the vector path, so no fused multiply-add.
+#pragma GCC optimize("fp-contract=off")
+
+#include <limits>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MT_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace mt {
+
+  // Squared distance, evaluated in the same order as the vector kernels.
+  static inline float dist2(float x, float y, float z, const glm::vec3& p) {
+    float dx = x - p.x;
+    float dy = y - p.y;
+    float dz = z - p.z;
+    return dx*dx + dy*dy + dz*dz;
+  }
+
+  static size_t within_scalar(const float* x, const float* y, const float* z, size_t start, size_t n,
+      const glm::vec3& p, float r2, uint32_t* idx, float* d2) {
+    size_t num = 0;
+    for (size_t i = start; i < n; ++i) {
+      float d = dist2(x[i], y[i], z[i], p);
+      if (d < r2) {
+        idx[num] = i;
+        d2[num] = d;
+        num++;
+      }
+    }
+    return num;
+  }
+
+  static size_t closest_scalar(const float* x, const float* y, const float* z, size_t start, size_t n,
+      const glm::vec3& p, float* d2, size_t res, float min) {
+    for (size_t i = start; i < n; ++i) {
+      float d = dist2(x[i], y[i], z[i], p);
+      if (d < min) {
+        min = d;
+        res = i;
+      }
+    }
+    *d2 = min;
+    return res;
+  }
+
+  // Cody-Waite reduction by pi/4 and minimax polynomials (Cephes sinf/cosf).
+  static const float fopi = 1.27323954473516f;
+  static const float dp1 = 0.78515625f;
+  static const float dp2 = 2.4187564849853515625e-4f;
+  static const float dp3 = 3.77489497744594108e-8f;
+  static const float sc0 = -1.9515295891e-4f, sc1 = 8.3321608736e-3f, sc2 = -1.6666654611e-1f;
+  static const float cc0 = 2.443315711809948e-5f, cc1 = -1.388731625493765e-3f, cc2 = 4.166664568298827e-2f;
+
+  static void sincos_scalar(const float* a, size_t start, size_t n, float* s, float* c) {
+    for (size_t i = start; i < n; ++i) {
+      float x = std::fabs(a[i]);
+      int j = (int)(x*fopi);
+      j += j & 1;
+      float y = (float)j;
+      x = ((x - y*dp1) - y*dp2) - y*dp3;
+      float z = x*x;
+      float ps = ((sc0*z + sc1)*z + sc2)*z*x + x;
+      float pc = ((cc0*z + cc1)*z + cc2)*z*z - 0.5f*z + 1.f;
+      bool swap = j & 2;
+      float sn = swap ? pc : ps;
+      float cs = swap ? ps : pc;
+      s[i] = ((j & 4) != 0) != std::signbit(a[i]) ? -sn : sn;
+      c[i] = ((j + 2) & 4) ? -cs : cs;
+    }
+  }
+
+#ifdef MT_SIMD_X86
+
+  // Squared distance of the 8 points starting at i.
+  __attribute__((target("avx2")))
+  static inline __m256 dist2_avx2(const float* x, const float* y, const float* z, size_t i,
+      __m256 px, __m256 py, __m256 pz) {
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), px);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), py);
+    __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), pz);
+    __m256 d = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    return _mm256_add_ps(d, _mm256_mul_ps(dz, dz));
+  }
+
+  __attribute__((target("avx2")))
+  static size_t within_avx2(const float* x, const float* y, const float* z, size_t n,
+      const glm::vec3& p, float r2, uint32_t* idx, float* d2) {
+    __m256 px = _mm256_set1_ps(p.x);
+    __m256 py = _mm256_set1_ps(p.y);
+    __m256 pz = _mm256_set1_ps(p.z);
+    __m256 r = _mm256_set1_ps(r2);
+    alignas(32) float d[8];
+
+    size_t num = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256 dv = dist2_avx2(x, y, z, i, px, py, pz);
+      int mask = _mm256_movemask_ps(_mm256_cmp_ps(dv, r, _CMP_LT_OQ));
+      if (!mask) continue;
+
+      // Compact the lanes which are in range.
+      _mm256_store_ps(d, dv);
+      while (mask) {
+        int k = __builtin_ctz(mask);
+        idx[num] = i + k;
+        d2[num] = d[k];
+        num++;
+        mask &= mask - 1;
+      }
+    }
+    // Avoid the AVX to SSE transition penalty in the scalar remainder.
+    _mm256_zeroupper();
+    return num + within_scalar(x, y, z, i, n, p, r2, idx + num, d2 + num);
+  }
+
+  __attribute__((target("avx2")))
+  static size_t closest_avx2(const float* x, const float* y, const float* z, size_t n,
+      const glm::vec3& p, float* d2) {
+    __m256 px = _mm256_set1_ps(p.x);
+    __m256 py = _mm256_set1_ps(p.y);
+    __m256 pz = _mm256_set1_ps(p.z);
+
+    // Per lane minimum; strict comparison keeps the first index of each lane.
+    __m256 min = _mm256_set1_ps(std::numeric_limits<float>::max());
+    __m256i arg = _mm256_set1_epi32(-1);
+    __m256i cur = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i eight = _mm256_set1_epi32(8);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256 dv = dist2_avx2(x, y, z, i, px, py, pz);
+      __m256 lt = _mm256_cmp_ps(dv, min, _CMP_LT_OQ);
+      min = _mm256_blendv_ps(min, dv, lt);
+      arg = _mm256_blendv_epi8(arg, cur, _mm256_castps_si256(lt));
+      cur = _mm256_add_epi32(cur, eight);
+    }
+
+    // Reduce lanes; on equal distances the lowest index wins.
+    alignas(32) float m[8];
+    alignas(32) int32_t a[8];
+    _mm256_store_ps(m, min);
+    _mm256_store_si256((__m256i*)a, arg);
+    size_t res = n;
+    float best = std::numeric_limits<float>::max();
+    for (int k = 0; k < 8; ++k) {
+      if (a[k] < 0) continue;
+      if (m[k] < best || (m[k] == best && (size_t)a[k] < res)) {
+        best = m[k];
+        res = a[k];
+      }
+    }
+    _mm256_zeroupper();
+    return closest_scalar(x, y, z, i, n, p, d2, res, best);
+  }
+
+  __attribute__((target("avx2")))
+  static void sincos_avx2(const float* a, size_t n, float* s, float* c) {
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    const __m256i four = _mm256_set1_epi32(4);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256 v = _mm256_loadu_ps(a + i);
+      __m256 x = _mm256_andnot_ps(sign, v);
+      __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(fopi)));
+      j = _mm256_add_epi32(j, _mm256_and_si256(j, one));
+      __m256 y = _mm256_cvtepi32_ps(j);
+      x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(dp1)));
+      x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(dp2)));
+      x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(dp3)));
+      __m256 z = _mm256_mul_ps(x, x);
+
+      __m256 ps = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(sc0), z), _mm256_set1_ps(sc1));
+      ps = _mm256_add_ps(_mm256_mul_ps(ps, z), _mm256_set1_ps(sc2));
+      ps = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ps, z), x), x);
+      __m256 pc = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(cc0), z), _mm256_set1_ps(cc1));
+      pc = _mm256_add_ps(_mm256_mul_ps(pc, z), _mm256_set1_ps(cc2));
+      pc = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(pc, z), z), _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+      pc = _mm256_add_ps(pc, _mm256_set1_ps(1.f));
+
+      // Select polynomial per octant and apply signs.
+      __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, two), two));
+      __m256 sn = _mm256_blendv_ps(ps, pc, swap);
+      __m256 cs = _mm256_blendv_ps(pc, ps, swap);
+      __m256 ss = _mm256_xor_ps(_mm256_and_ps(v, sign),
+          _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, four), 29)));
+      __m256 cn = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(j, two), four), 29));
+      _mm256_storeu_ps(s + i, _mm256_xor_ps(sn, ss));
+      _mm256_storeu_ps(c + i, _mm256_xor_ps(cs, cn));
+    }
+    _mm256_zeroupper();
+    sincos_scalar(a, i, n, s, c);
+  }
+
+  static bool has_avx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+  }
+
+#else
+
+  static bool has_avx2() { return false; }
+
+#endif
+
+  size_t within(const float* x, const float* y, const float* z, size_t n,
+      const glm::vec3& p, float r2, uint32_t* idx, float* d2) {
+#ifdef MT_SIMD_X86
+    if (n >= 8 && has_avx2()) return within_avx2(x, y, z, n, p, r2, idx, d2);
+#endif
+    return within_scalar(x, y, z, 0, n, p, r2, idx, d2);
+  }
+
+  size_t closest(const float* x, const float* y, const float* z, size_t n,
+      const glm::vec3& p, float* d2) {
+#ifdef MT_SIMD_X86
+    if (n >= 8 && has_avx2()) return closest_avx2(x, y, z, n, p, d2);
+#endif
+    return closest_scalar(x, y, z, 0, n, p, d2, n, std::numeric_limits<float>::max());
+  }
+
+  void sincos(const float* a, size_t n, float* s, float* c) {
+#ifdef MT_SIMD_X86
+    if (n >= 8 && has_avx2()) return sincos_avx2(a, n, s, c);
+#endif
+    sincos_scalar(a, 0, n, s, c);
+  }
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+namespace mt {
+
+  // Squared distance kernels over structure-of-arrays points. An AVX2 path is
+  // picked at runtime when the CPU supports it; it gives the exact same
+  // results as the scalar path.
+
+  // Store index and squared distance of all points closer than sqrt(r2) to p.
+  // Output arrays must hold n elements. Returns the number of points stored.
+  size_t within(const float* x, const float* y, const float* z, size_t n,
+      const glm::vec3& p, float r2, uint32_t* idx, float* d2);
+
+  // Return index of the point closest to p (the first one on ties) and its
+  // squared distance in d2. Returns n if there are no points.
+  size_t closest(const float* x, const float* y, const float* z, size_t n,
+      const glm::vec3& p, float* d2);
+
+  // Store sine and cosine of the n angles in a. Accurate to a few ulp for
+  // |a| < 8192.
+  void sincos(const float* a, size_t n, float* s, float* c);
+
+}